@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/editor.h"
+#include "../include/row.h"
+#include "../include/highlight.h"
+#include "../include/syntax.h"
+#include "../include/fileio.h"
+
+/*
+ * Measures how fast rows are highlighted.
+ *
+ *   bench_highlight FILE
+ *
+ * FILE is opened with the syntax its name selects and its rows are rendered
+ * once. Then they are highlighted from the top, as scrolling through the
+ * file does, until at least BENCH_BYTES have been lexed.
+ */
+
+#define BENCH_BYTES (64 << 20)
+
+struct editorConfig E;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: bench_highlight FILE\n");
+		return 1;
+	}
+
+	E.matches = -1;
+	editorLoadSyntaxes();
+	editorOpen(argv[1]);
+	editorFinishOpen();
+	if (E.syntax == NULL)
+	{
+		fprintf(stderr, "bench_highlight: no syntax for %s\n", argv[1]);
+		return 1;
+	}
+
+	size_t bytes = 0;
+	for (int i = 0; i < E.numrows; ++i)
+		bytes += editorRenderedRow(i)->rsize + 1;
+	if (bytes == 0)
+	{
+		fprintf(stderr, "bench_highlight: %s is empty\n", argv[1]);
+		return 1;
+	}
+
+	size_t done = 0;
+	double t = 0;
+	while (done < BENCH_BYTES)
+	{
+		// forgets the states, so that every row is lexed again
+		editorSelectSyntaxHighlight();
+		double start = benchNow();
+		for (int i = 0; i < E.numrows; ++i)
+			editorRow(i);
+		t += benchNow() - start;
+		done += bytes;
+	}
+
+	printf("highlight: %s, %zu bytes, %.1f MB/s\n", argv[1], bytes,
+		done / t / 1e6);
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/editor.h"
+#include "../include/ptable.h"
+#include "../include/fileio.h"
+
+/*
+ * Measures inserting rows at the top of a document.
+ *
+ *   bench_insert FILE
+ *
+ * FILE is opened and BENCH_ROWS rows are inserted one at a time at row 0
+ * with ptInsertRow(), so every insert moves all the rows after it down.
+ * Then the line number of each inserted row is looked up with
+ * ptRowIndex().
+ */
+
+#define BENCH_ROWS 100000
+
+struct editorConfig E;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: bench_insert FILE\n");
+		return 1;
+	}
+
+	E.matches = -1;
+	editorOpen(argv[1]);
+	editorFinishOpen();
+	int rows = E.numrows;
+
+	static erow *inserted[BENCH_ROWS];
+	char line[32];
+	double start = benchNow();
+	for (int i = 0; i < BENCH_ROWS; ++i)
+	{
+		int len = snprintf(line, sizeof(line), "inserted row %d", i);
+		inserted[i] = ptInsertRow(0, line, len);
+	}
+	double insert = benchNow() - start;
+
+	start = benchNow();
+	for (int i = 0; i < BENCH_ROWS; ++i)
+	{
+		if (ptRowIndex(inserted[i]) != BENCH_ROWS - 1 - i)
+		{
+			fprintf(stderr, "bench_insert: row %d is out of place\n", i);
+			return 1;
+		}
+	}
+	double index = benchNow() - start;
+
+	printf("insert: %s, %d rows, %d inserted at row 0 in %.1f ms, "
+		"%.3f us each to number\n", argv[1], rows, BENCH_ROWS,
+		insert * 1e3, index * 1e6 / BENCH_ROWS);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/editor.h"
+#include "../include/fileio.h"
+
+/*
+ * Measures how fast a file is split into lines when it is opened.
+ *
+ *   bench_load FILE
+ *
+ * FILE is read first as the editor used to, one getline() at a time, and
+ * then mapped and searched for newlines one memchr() at a time, the scalar
+ * path of the indexer. Both also bring it into the page cache. Then it is
+ * opened with editorOpen() and indexed to the end with editorFinishOpen().
+ * Threads are only started for big files, so FILE should be a big one.
+ */
+
+struct editorConfig E;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long benchGetline(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	long rows = 0;
+	while ((len = getline(&line, &cap, fp)) != -1)
+	{
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			--len;
+		++rows;
+	}
+	free(line);
+	fclose(fp);
+	return rows;
+}
+
+static long benchMemchr(const char *filename, size_t *size)
+{
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		perror(filename);
+		exit(1);
+	}
+	*size = st.st_size;
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	const char *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(1);
+	}
+	const char *q = p, *end = p + st.st_size;
+	long rows = (end[-1] != '\n');
+	while ((q = memchr(q, '\n', end - q)) != NULL)
+	{
+		++rows;
+		++q;
+	}
+	munmap((void *)p, st.st_size);
+	return rows;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: bench_load FILE\n");
+		return 1;
+	}
+
+	double start = benchNow();
+	long rows = benchGetline(argv[1]);
+	double getline = benchNow() - start;
+
+	size_t size;
+	start = benchNow();
+	benchMemchr(argv[1], &size);
+	double scalar = benchNow() - start;
+
+	E.matches = -1;
+	start = benchNow();
+	editorOpen(argv[1]);
+	editorFinishOpen();
+	double open = benchNow() - start;
+
+	if (E.numrows != rows)
+	{
+		fprintf(stderr, "bench_load: %d rows indexed, %ld read\n", E.numrows,
+			rows);
+		return 1;
+	}
+	printf("load: %s, %zu bytes, %ld rows, getline %.2f GB/s, "
+		"memchr %.2f GB/s, editorOpen %.2f GB/s\n", argv[1], size, rows,
+		size / getline / 1e9, size / scalar / 1e9, size / open / 1e9);
+	return 0;
+}
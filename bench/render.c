@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../include/editor.h"
+#include "../include/syntax.h"
+#include "../include/palette.h"
+#include "../include/screen.h"
+#include "../include/fileio.h"
+#include "../include/output.h"
+
+/*
+ * Measures how long a frame takes to build and write.
+ *
+ *   bench_render FILE
+ *
+ * FILE is drawn on a BENCH_ROWS by BENCH_COLS screen, with the frames
+ * written to /dev/null: unchanged, so that nothing but the status bar is
+ * compared and written, redrawn in full, and scrolled by a row at a time.
+ */
+
+#define BENCH_ROWS 48
+#define BENCH_COLS 120
+#define BENCH_FRAMES 2000
+
+struct editorConfig E;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the microseconds a frame took, with 'step' called before each. */
+static double benchFrames(void (*step)())
+{
+	double start = benchNow();
+	for (int i = 0; i < BENCH_FRAMES; ++i)
+	{
+		step();
+		editorRefreshScreen();
+	}
+	return (benchNow() - start) * 1e6 / BENCH_FRAMES;
+}
+
+static void benchSame()
+{
+}
+
+static void benchFull()
+{
+	screenInvalidate();
+}
+
+static void benchScroll()
+{
+	// one row past the screen, so that it scrolls by a row
+	E.cy = E.rowoff + E.screenrows;
+	if (E.cy >= E.numrows)
+		E.cy = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: bench_render FILE\n");
+		return 1;
+	}
+
+	E.screenrows = BENCH_ROWS - 2;
+	E.screencols = BENCH_COLS;
+	E.prev_screenrows = E.screenrows;
+	E.prev_screencols = E.screencols;
+	E.matches = -1;
+	editorLoadSyntaxes();
+	editorLoadPalette();
+	editorOpen(argv[1]);
+	editorFinishOpen();
+	editorSetStatusMessage("HELP: Ctrl-S save | Ctrl-Q quit | Ctrl-F find");
+
+	// the results go to the real stdout, the frames to /dev/null
+	FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+	int null = open("/dev/null", O_WRONLY);
+	if (out == NULL || null == -1 || dup2(null, STDOUT_FILENO) == -1)
+	{
+		perror("bench_render");
+		return 1;
+	}
+
+	editorRefreshScreen();
+	double same = benchFrames(benchSame);
+	double full = benchFrames(benchFull);
+	double scroll = benchFrames(benchScroll);
+
+	fprintf(out, "render: %s, %dx%d, %.1f us unchanged, %.1f us full, "
+		"%.1f us scrolled\n", argv[1], BENCH_COLS, BENCH_ROWS, same, full,
+		scroll);
+	return 0;
+}
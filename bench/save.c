@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../include/editor.h"
+#include "../include/row.h"
+#include "../include/ptable.h"
+#include "../include/fileio.h"
+
+/*
+ * Measures how fast a document is saved and how much memory it takes.
+ *
+ *   bench_save FILE [MB]
+ *
+ * FILE is repeated into a temporary file of MB megabytes, BENCH_MB by
+ * default, which is opened, edited in its first row and saved BENCH_SAVES
+ * times. The best throughput is printed with the peak RSS before and after
+ * the saves.
+ */
+
+#define BENCH_MB 128
+#define BENCH_SAVES 3
+
+struct editorConfig E;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long benchPeakRss()
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss / 1024;
+}
+
+/* Writes copies of 'filename' to a new temporary file, and returns the
+   temporary file's name. */
+static char *benchMakeFile(const char *filename, size_t size)
+{
+	FILE *in = fopen(filename, "rb");
+	if (in == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	char buf[1 << 16];
+	size_t n = fread(buf, 1, sizeof(buf), in);
+	fclose(in);
+	if (n == 0)
+	{
+		fprintf(stderr, "bench_save: %s is empty\n", filename);
+		exit(1);
+	}
+	if (buf[n - 1] != '\n' && n < sizeof(buf))
+		buf[n++] = '\n';
+
+	char *tmp = strdup("/tmp/bench_save.XXXXXX");
+	int fd = mkstemp(tmp);
+	if (fd == -1)
+	{
+		perror("mkstemp");
+		exit(1);
+	}
+	for (size_t written = 0; written < size; written += n)
+	{
+		if (write(fd, buf, n) != n)
+		{
+			perror("write");
+			unlink(tmp);
+			exit(1);
+		}
+	}
+	close(fd);
+	return tmp;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2 && argc != 3)
+	{
+		fprintf(stderr, "usage: bench_save FILE [MB]\n");
+		return 1;
+	}
+	size_t mb = (argc == 3 && atoi(argv[2]) > 0) ? atoi(argv[2]) : BENCH_MB;
+	char *tmp = benchMakeFile(argv[1], mb << 20);
+
+	E.matches = -1;
+	editorOpen(tmp);
+	editorFinishOpen();
+	editorRowInsertChar(ptRow(0), 0, 'x');
+	long before = benchPeakRss();
+
+	double best = 0;
+	size_t bytes = 0;
+	for (int i = 0; i < BENCH_SAVES; ++i)
+	{
+		double start = benchNow();
+		editorSave();
+		editorFinishSave();
+		double t = benchNow() - start;
+		if (E.dirty)
+		{
+			fprintf(stderr, "bench_save: %s\n", E.statusmsg);
+			unlink(tmp);
+			return 1;
+		}
+		sscanf(E.statusmsg, "%zu", &bytes);
+		if (best == 0 || t < best)
+			best = t;
+	}
+	unlink(tmp);
+
+	printf("save: %s repeated to %zu bytes, %.1f MB/s, "
+		"peak RSS %ld MB opened, %ld MB saved\n", argv[1], bytes,
+		bytes / best / 1e6, before, benchPeakRss());
+	return 0;
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <regex.h>
+
+#include "../include/editor.h"
+#include "../include/scan.h"
+#include "../include/regex.h"
+
+/*
+ * Compares the ways lines can be searched for a pattern.
+ *
+ *   bench_search FILE [PATTERN...]
+ *
+ * FILE is read and repeated in memory up to BENCH_BYTES, and the lines
+ * matching each pattern are found with scanFind() when the pattern is
+ * literal, with reFindLine() and reMatch() as a regular expression search
+ * does, and with regexec() from libc run on each line in turn.
+ *
+ * Last, all the matches of x|a.*y are found with reMatchAll() in a line of
+ * BENCH_LINE bytes and in one four times as long. An "a" begins a match
+ * that is only given up at the end of the line, so the time would grow
+ * sixteen times if the matches after it were looked for from scratch.
+ */
+
+#define BENCH_BYTES (32 << 20)
+#define BENCH_LINE (1 << 20)
+
+struct editorConfig E;
+
+static const char *patterns[] =
+{
+	"return",
+	"editorRow",
+	"for \\(int [a-z]+ = 0",
+	"ERROR.*timeout=[0-9]+",
+	"[a-z]+\\([a-z]*\\);",
+	NULL
+};
+
+static char *text;
+static size_t len;
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchRead(const char *filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	size_t cap = 1 << 16;
+	char *file = malloc(cap);
+	size_t n = 0, got;
+	while ((got = fread(file + n, 1, cap - n, fp)) > 0)
+	{
+		n += got;
+		if (n == cap)
+			file = realloc(file, cap *= 2);
+	}
+	fclose(fp);
+	if (n == 0)
+	{
+		fprintf(stderr, "bench_search: %s is empty\n", filename);
+		exit(1);
+	}
+
+	// whole copies, each ending in a newline
+	int nl = (file[n - 1] != '\n');
+	size_t copies = BENCH_BYTES / (n + nl) + 1;
+	len = copies * (n + nl);
+	text = malloc(len + 1);
+	for (size_t i = 0; i < copies; ++i)
+	{
+		char *p = text + i * (n + nl);
+		memcpy(p, file, n);
+		if (nl)
+			p[n] = '\n';
+	}
+	text[len] = '\0';
+	free(file);
+}
+
+static size_t benchLiteral(const char *pattern)
+{
+	const char *p = text, *end = text + len;
+	size_t m = strlen(pattern), lines = 0;
+	while ((p = scanFind(p, end - p, pattern, m)) != NULL)
+	{
+		++lines;
+		p = memchr(p, '\n', end - p) + 1;
+	}
+	return lines;
+}
+
+static size_t benchRegex(regex *re)
+{
+	const char *p = text, *end = text + len;
+	size_t lines = 0;
+	while ((p = reFindLine(re, p, end - p)) != NULL)
+	{
+		const char *eol = memchr(p, '\n', end - p);
+		int mlen;
+		if (reMatch(re, p, eol - p, 0, &mlen) >= 0)
+			++lines;
+		p = eol + 1;
+	}
+	return lines;
+}
+
+static size_t benchRegexec(regex_t *re)
+{
+	char *p = text, *end = text + len;
+	size_t lines = 0;
+	while (p < end)
+	{
+		char *eol = memchr(p, '\n', end - p);
+		*eol = '\0';
+		if (regexec(re, p, 0, NULL, 0) == 0)
+			++lines;
+		*eol = '\n';
+		p = eol + 1;
+	}
+	return lines;
+}
+
+static void benchCount(void *arg, int start, int len)
+{
+	++*(size_t *)arg;
+}
+
+/* Returns the seconds it takes to find the matches in n bytes of "axax...". */
+static double benchLongLine(regex *re, int n, size_t *matches)
+{
+	char *line = malloc(n);
+	for (int i = 0; i < n; ++i)
+		line[i] = (i & 1) ? 'x' : 'a';
+
+	*matches = 0;
+	double start = benchNow();
+	reMatchAll(re, line, n, benchCount, matches);
+	double t = benchNow() - start;
+	free(line);
+	return t;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: bench_search FILE [PATTERN...]\n");
+		return 1;
+	}
+	benchRead(argv[1]);
+	printf("search: %s, repeated to %zu bytes, MB/s and lines found\n",
+		argv[1], len);
+
+	const char **pats = (argc > 2) ? (const char **)argv + 2 : patterns;
+	for (int i = 0; pats[i] != NULL; ++i)
+	{
+		const char *pattern = pats[i];
+		printf("  %-24s", pattern);
+
+		if (strpbrk(pattern, "\\^$.|?*+()[]{}") == NULL)
+		{
+			double start = benchNow();
+			size_t lines = benchLiteral(pattern);
+			printf(" literal %8.1f %8zu", len / (benchNow() - start) / 1e6, lines);
+		}
+		else
+			printf("%26s", "");
+
+		regex *re = reCompile(pattern);
+		if (re)
+		{
+			double start = benchNow();
+			size_t lines = benchRegex(re);
+			printf(" regex %8.1f %8zu", len / (benchNow() - start) / 1e6, lines);
+			reFree(re);
+		}
+
+		regex_t libc;
+		if (regcomp(&libc, pattern, REG_EXTENDED | REG_NOSUB) == 0)
+		{
+			double start = benchNow();
+			size_t lines = benchRegexec(&libc);
+			printf(" regexec %8.1f %8zu", len / (benchNow() - start) / 1e6, lines);
+			regfree(&libc);
+		}
+		printf("\n");
+	}
+
+	regex *re = reCompile("x|a.*y");
+	size_t short_matches, long_matches;
+	double short_line = benchLongLine(re, BENCH_LINE, &short_matches);
+	double long_line = benchLongLine(re, BENCH_LINE * 4, &long_matches);
+	reFree(re);
+	printf("  %-24s %d bytes %.1f ms %zu, %d bytes %.1f ms %zu\n", "x|a.*y in one line",
+		BENCH_LINE, short_line * 1e3, short_matches, BENCH_LINE * 4,
+		long_line * 1e3, long_matches);
+	if (long_line > short_line * 8)
+	{
+		fprintf(stderr, "bench_search: the time to match a line grows faster than it\n");
+		return 1;
+	}
+	return 0;
+}
@@ -1,12 +1,20 @@
 #pragma once
 
-#define ABUF_INIT {NULL, 0}
+#include <sys/uio.h>
 
+#define ABUF_INIT {NULL, 0, 0}
+
+/* A buffer that grows geometrically and keeps its memory when reset, so one
+   that lives across frames stops allocating once it is big enough. */
 struct abuf
 {
 	char *b;
 	int len;
+	int cap;
 };
 
+void abReserve(struct abuf *ab, int len);
 void abAppend(struct abuf *ab, const char *s, int len);
-void abFree(struct abuf *ab);
\ No newline at end of file
+void abReset(struct abuf *ab);
+void abFree(struct abuf *ab);
+int abWritev(int fd, struct iovec *iov, int n);
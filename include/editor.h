@@ -16,7 +16,25 @@ enum editorKey
 	HOME_KEY,
 	END_KEY,
 	PAGE_UP,
-	PAGE_DOWN
+	PAGE_DOWN,
+	F1_KEY, // F1_KEY + n - 1 is Fn, up to F12
+	PASTE_START = F1_KEY + 12, // the text that follows is read with editorReadPaste()
+	MOUSE_EVENT // see E.mouse
+};
+
+/* Modifiers held with a key are or'ed into it. */
+#define KEY_SHIFT (1 << 16)
+#define KEY_ALT (1 << 17)
+#define KEY_CTRL (1 << 18)
+#define KEY_MODS (KEY_SHIFT | KEY_ALT | KEY_CTRL)
+
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+struct editorMouse
+{
+	int button; // 0 to 2 for left, middle and right, 64 and 65 for the wheel
+	int x, y; // the cell, counted from 0
+	int pressed;
 };
 
 struct editorConfig
@@ -30,12 +48,20 @@ struct editorConfig
 	int prev_screenrows;
 	int prev_screencols;
 	int numrows;
+	int loading; // rows are still being indexed, see editorPollOpen()
+	int highlighting; // see editorPollHighlight()
+	int searching; // see editorPollFind()
+	int saving; // see editorPollSave()
+	int saved; // percent of the save written
 	int volnum;
-	erow *row;
 	int dirty;
 	char *filename;
 	char statusmsg[80];
 	time_t statusmsg_time;
+	struct editorMouse mouse; // of the last MOUSE_EVENT
+	int matches; // found by the search in progress, -1 when there is none
+	int match; // the one at the cursor, counted from 1
+	int regex; // the search is for a regular expression
 	struct editorSyntax *syntax;
 	struct termios orig_termios;
 };
\ No newline at end of file
@@ -2,4 +2,5 @@
 
 void editorInsertChar(int c);
 void editorInsertNewline();
+void editorInsertText(char *s, int len);
 void editorDelChar();
\ No newline at end of file
@@ -1,4 +1,8 @@
 #pragma once
 
 void editorOpen(char *filename);
-void editorSave();
\ No newline at end of file
+void editorPollOpen();
+void editorFinishOpen();
+void editorSave();
+void editorPollSave();
+void editorFinishSave();
\ No newline at end of file
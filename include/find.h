@@ -1,3 +1,5 @@
 #pragma once
 
-void editorFind();
\ No newline at end of file
+void editorFind();
+void editorReplace();
+void editorPollFind();
\ No newline at end of file
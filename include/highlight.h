@@ -2,6 +2,8 @@
 
 #include "row.h"
 
+struct kwtable;
+
 enum editorHighlight
 {
 	HL_NORMAL = 0,
@@ -11,29 +13,49 @@ enum editorHighlight
 	HL_KEYWORD2,
 	HL_STRING,
 	HL_NUMBER,
-	HL_MATCH
+	HL_MATCH,
+	HL_NCLASSES // the number of classes, not one itself
 };
 
-typedef struct editorColor
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+
+#define HL_MAX_BLOCKS 4
+
+/* Lexer classes of a byte, see editorCompileSyntax(). */
+#define LX_SEP (1 << 0) // ends a word
+#define LX_START (1 << 1) // may start a comment, block or string
+#define LX_QUOTE (1 << 2)
+#define LX_DIGIT (1 << 3)
+#define LX_NUM (1 << 4) // continues a number
+
+/* Text from start to end that may span rows, such as a block comment. Row
+   states are 0 outside of any and k + 1 inside blocks[k]. */
+struct editorBlock
 {
-	int R;
-	int G;
-	int B;
-	int fgOrBg; // foreground or background
-	int colorIndex;
-} editorColor;
+	char *start;
+	char *end;
+	int slen;
+	int elen;
+	int hl;
+};
 
 struct editorSyntax
 {
 	char *filetype;
 	char **filematch;
-	char **keywords;
+	const struct kwtable *keywords;
 	char *singleline_comment_start;
-	char *multiline_comment_start;
-	char *multiline_comment_end;
+	struct editorBlock blocks[HL_MAX_BLOCKS];
+	int nblocks;
+	char *quotes;
+	char *separators; // besides white space and '\0'
 	int flags;
+	int kwstart; // a keyword holds an LX_START byte
+	unsigned char cls[256];
 };
 
-void editorUpdateSyntax(erow *row);
-void editorSelectSyntaxHighlight();
-editorColor *editorSyntaxToColor(int hl);
\ No newline at end of file
+void editorUpdateSyntax(erow *row, int at);
+void editorHighlightEdited(int at);
+void editorHighlightShift(int at, int n);
+void editorPollHighlight();
+void editorSelectSyntaxHighlight();
\ No newline at end of file
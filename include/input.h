@@ -1,4 +1,4 @@
 #pragma once
 
-char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPrompt(char *prompt, void (*callback)(char *, int), int allow_empty);
 void editorProcessKeypress();
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * Keyword tables are perfect hash tables: every keyword of a language has a
+ * slot of its own, so looking a word up costs one hash of it and one compare.
+ * kwBuild() searches for a seed under which kwHash() has no collisions. It
+ * runs at build time for the built-in language, through tools/kwgen.c, and at
+ * startup for the ones loaded from syntax files. A word listed twice would
+ * collide under every seed, so the lists are kept free of repeats with
+ * kwListed().
+ */
+
+struct kwentry
+{
+	const char *word;
+	int len;
+	int hl;
+};
+
+struct kwtable
+{
+	const struct kwentry *slots;
+	unsigned int mask; // slots - 1, the number of slots is a power of two
+	unsigned int seed;
+	int maxlen;
+};
+
+static inline unsigned int kwHash(unsigned int seed, const char *s, int len)
+{
+	unsigned int h = seed;
+	for (int i = 0; i < len; ++i)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+int kwListed(const struct kwentry *words, int n, const char *s, int len);
+int kwBuild(struct kwtable *t, const struct kwentry *words, int n);
@@ -1,4 +1,6 @@
 #pragma once
 
+void editorScroll();
 void editorRefreshScreen();
+int editorStatusTimeout();
 void editorSetStatusMessage(const char *fmt, ...);
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "highlight.h"
+
+struct sgr
+{
+	char seq[24];
+	int len;
+};
+
+/* The escape that selects the color of each highlight class. */
+extern struct sgr palette[HL_NCLASSES];
+
+void editorLoadPalette();
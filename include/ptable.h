@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "row.h"
+
+typedef struct ptiter
+{
+	struct piece *piece;
+	int line; // line within the piece
+	size_t off; // start of that line in the original buffer
+} ptiter;
+
+int ptOpen(const char *filename);
+int ptPoll();
+int ptLoading();
+int ptFinishLoad();
+erow *ptRow(int at);
+int ptRowIndex(erow *row);
+erow *ptInsertRow(int at, const char *s, size_t len);
+int ptInsertRows(int at, const char *s, size_t len);
+void ptDelRow(int at);
+void ptDelRows(int at, int n);
+void ptForEachRow(void (*fn)(erow *row));
+void ptIterInit(ptiter *it, int at);
+int ptIterNext(ptiter *it, erow **row, char **s, int *len);
+int ptIterSpan(ptiter *it, erow **row, char **s, size_t *len, int *n);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct regex regex;
+
+regex *reCompile(const char *pattern);
+void reFree(regex *re);
+const char *reFindLine(regex *re, const char *p, size_t len);
+int reMatch(regex *re, const char *s, int len, int from, int *mlen);
+void reMatchAll(regex *re, const char *s, int len,
+	void (*found)(void *arg, int start, int len), void *arg);
\ No newline at end of file
@@ -2,22 +2,49 @@
 
 #include <stdlib.h>
 
+struct piece;
+
 typedef struct erow
 {
-	int idx;
+	struct piece *piece; // the piece holding the row, see ptRowIndex()
 	int size;
 	int rsize;
-	char *chars;
+	char *chars; // not NUL terminated, may point into a piece buffer
+	int owned; // chars is a malloc'd gap buffer
+	int gap;
+	int gaplen;
 	char *render;
+	int rcap; // capacity of render and hl
 	unsigned char *hl;
-	int hl_open_comment;
+	int hl_state; // the state hl was built from, -1 when out of date
+	int stale; // render and hl are rebuilt before the row is next used
 } erow;
 
+/* Replaces len bytes at row, col with s. */
+struct rowEdit
+{
+	int row;
+	int col;
+	int len;
+	const char *s;
+	int slen;
+};
+
 int editorRowCxToRx(erow *row, int cx);
 int editorRowRxToCx(erow *row, int rx);
+char *editorRowCharsFrom(erow *row, int at);
+erow *editorRenderedRow(int at);
+erow *editorRow(int at);
+void editorInvalidateRow(erow *row);
 void editorUpdateRow(erow *row);
 void editorInsertRow(int at, char *s, size_t len);
+int editorInsertRows(int at, char *s, size_t len);
 void editorDelRow(int at);
+void editorDelRows(int at, int n);
 void editorRowInsertChar(erow *row, int at, int c);
 void editorRowAppendString(erow *row, char *s, size_t len);
-void editorRowDelChar(erow *row, int at);
\ No newline at end of file
+void editorRowInsertString(erow *row, int at, char *s, size_t len);
+void editorRowDelChar(erow *row, int at);
+void editorRowDelString(erow *row, int at, int len);
+void editorRowTruncate(erow *row, int at);
+void editorRowsReplace(const struct rowEdit *edits, int n);
\ No newline at end of file
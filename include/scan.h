@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stddef.h>
+
+size_t scanCountLines(const char *p, size_t len);
+const char *scanSkipLines(const char *p, size_t len, size_t n);
+const char *scanFind(const char *p, size_t len, const char *needle, size_t m);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "abuf.h"
+#include "highlight.h"
+
+/* Attributes of a screen cell: the highlight class whose color it is drawn
+   in, or SCREEN_PLAIN for the terminal's own, and maybe SCREEN_INVERSE. */
+#define SCREEN_PLAIN HL_NCLASSES
+#define SCREEN_INVERSE 0x80
+
+void screenBegin(int rows, int cols);
+void screenAppend(int y, const char *s, int len, int attr);
+void screenAppendHighlighted(int y, const char *s, const unsigned char *hl,
+	int len);
+void screenScroll(int top, int bottom, int n);
+void screenFlush(struct abuf *ab);
+void screenInvalidate();
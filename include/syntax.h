@@ -0,0 +1,6 @@
+#pragma once
+
+#include "highlight.h"
+
+void editorLoadSyntaxes();
+struct editorSyntax *editorFindSyntax(const char *filename);
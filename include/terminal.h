@@ -3,4 +3,6 @@
 void die(const char *s);
 void enableRawMode();
 int editorReadKey();
+char *editorReadPaste(int *len);
+int editorInputPending(int timeout);
 int getWindowSize(int *rows, int *cols);
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+struct rowEdit;
+
+void editorUndoMark();
+void editorUndo();
+void editorRedo();
+void editorJournalInsert(int at, int col, const char *s, int len, int typed);
+void editorJournalDelete(int at, int col, const char *s, int len, int typed);
+void editorJournalInsertRows(int at, const char *s, size_t len, int n);
+void editorJournalDeleteRows(int at, int n);
+void editorJournalReplace(const struct rowEdit *edits, int n);
\ No newline at end of file
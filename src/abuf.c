@@ -1,22 +1,89 @@
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "../include/abuf.h"
 
+#define ABUF_MIN 4096
+
 /*** append buffer ***/
 
-void abAppend(struct abuf *ab, const char *s, int len)
+/* Makes room for len more bytes. */
+void abReserve(struct abuf *ab, int len)
 {
-	char *new = realloc(ab->b, ab->len + len);
+	if (ab->len + len <= ab->cap)
+		return;
 
+	int cap = ab->cap ? ab->cap : ABUF_MIN;
+	while (cap < ab->len + len)
+		cap *= 2;
+	char *new = realloc(ab->b, cap);
 	if (new == NULL)
 		return;
-	memcpy(&new[ab->len], s, len);
 	ab->b = new;
+	ab->cap = cap;
+}
+
+void abAppend(struct abuf *ab, const char *s, int len)
+{
+	if (ab->len + len > ab->cap)
+	{
+		abReserve(ab, len);
+		if (ab->len + len > ab->cap)
+			return;
+	}
+	memcpy(&ab->b[ab->len], s, len);
 	ab->len += len;
 }
 
+void abReset(struct abuf *ab)
+{
+	ab->len = 0;
+}
+
 void abFree(struct abuf *ab)
 {
 	free(ab->b);
-}
\ No newline at end of file
+	ab->b = NULL;
+	ab->len = 0;
+	ab->cap = 0;
+}
+
+/*** writing ***/
+
+/* Writes all of iov to fd, going on after short writes and waiting when fd
+   would block. Returns 0, or -1 with errno set. */
+int abWritev(int fd, struct iovec *iov, int n)
+{
+	while (n > 0)
+	{
+		ssize_t written = writev(fd, iov, n);
+		if (written == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+			{
+				struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+				poll(&pfd, 1, -1);
+				continue;
+			}
+			return -1;
+		}
+
+		while (n > 0 && (size_t)written >= iov->iov_len)
+		{
+			written -= iov->iov_len;
+			++iov;
+			--n;
+		}
+		if (n > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return 0;
+}
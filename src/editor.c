@@ -1,14 +1,39 @@
+#include <stdlib.h>
+
 #include "../include/editor.h"
 #include "../include/row.h"
 #include "../include/highlight.h"
+#include "../include/syntax.h"
+#include "../include/palette.h"
 #include "../include/terminal.h"
 #include "../include/editorOp.h"
 #include "../include/fileio.h"
 #include "../include/output.h"
 #include "../include/input.h"
 
+#define KILO_FRAME_MS 16 // least time between frames while input keeps coming
+
 struct editorConfig E;
 
+static int frame_ms = KILO_FRAME_MS; // KILO_FRAME_MS in the environment, 0 for no cap
+
+/*** frames ***/
+
+static long editorNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Returns how long to wait for more input before drawing again, for a
+   frame drawn at 'frame'. */
+static int editorFrameWait(long frame)
+{
+	long wait = frame + frame_ms - editorNow();
+	return wait > 0 ? wait : 0;
+}
+
 /*** init ***/
 
 void initEditor()
@@ -19,12 +44,16 @@ void initEditor()
 	E.rowoff = 0;
 	E.coloff = 0;
 	E.numrows = 0;
-	E.row = NULL;
+	E.loading = 0;
+	E.highlighting = 0;
+	E.searching = 0;
+	E.saving = 0;
 	E.dirty = 0;
 	E.filename = NULL;
 	E.statusmsg[0] = '\0';
 	E.statusmsg_time = 0;
 	E.syntax = NULL;
+	E.matches = -1;
 
 	if (getWindowSize(&E.screenrows, &E.screencols) == -1)
 		die("getWindowSize");
@@ -37,15 +66,36 @@ int main(int argc, char *argv[])
 {
 	enableRawMode();
 	initEditor();
+	editorLoadSyntaxes();
+	editorLoadPalette();
 	if (argc >= 2)
 		editorOpen(argv[1]);
 
-	editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+	char *ms = getenv("KILO_FRAME_MS");
+	if (ms)
+		frame_ms = (atoi(ms) > 0) ? atoi(ms) : 0;
+
+	editorSetStatusMessage("HELP: Ctrl-S save | Ctrl-Q quit | Ctrl-F/R find/replace | Ctrl-Z/Y undo/redo");
 
 	while (1)
 	{
+		editorPollOpen();
+		editorPollHighlight();
+		editorPollSave();
 		editorRefreshScreen();
+		long frame = editorNow();
 		editorProcessKeypress();
+
+		// keys that come within frame_ms of the last frame, like the rest
+		// of a paste, are applied before the next frame is drawn, so a long
+		// burst still shows progress. Keys like PAGE_DOWN act on the scroll
+		// position, so it is kept up to date between them.
+		int wait;
+		while ((wait = editorFrameWait(frame)) > 0 && editorInputPending(wait))
+		{
+			editorScroll();
+			editorProcessKeypress();
+		}
 	}
 
 	return 0;
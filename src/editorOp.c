@@ -1,5 +1,10 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
 #include "../include/editor.h"
 #include "../include/row.h"
+#include "../include/ptable.h"
 
 extern struct editorConfig E;
 
@@ -9,7 +14,7 @@ void editorInsertChar(int c)
 {
 	if (E.cy == E.numrows)
 		editorInsertRow(E.cy, "", 0);
-	editorRowInsertChar(&E.row[E.cy], E.cx, c);
+	editorRowInsertChar(ptRow(E.cy), E.cx, c);
 	E.cx++;
 }
 
@@ -21,23 +26,68 @@ void editorInsertNewline()
 	}
 	else
 	{
-		erow *row = &E.row[E.cy];
-		editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-		row = &E.row[E.cy];
-		row->size = E.cx;
-		row->chars[row->size] = '\0';
-		editorUpdateRow(row);
+		erow *row = ptRow(E.cy);
+		editorInsertRow(E.cy + 1, editorRowCharsFrom(row, E.cx), row->size - E.cx);
+		editorRowTruncate(ptRow(E.cy), E.cx);
 	}
 	++E.cy;
 	E.cx = 0;
 }
 
+/* Inserts text at the cursor as a single edit, the way a paste should be:
+   the first line goes into the cursor's row, and the rest, along with what
+   followed the cursor, become new rows all at once. Line ends may be \r,
+   \n or \r\n. s is rewritten in place. */
+void editorInsertText(char *s, int len)
+{
+	int n = 0;
+	for (int i = 0; i < len; ++i)
+	{
+		if (s[i] == '\r' && i + 1 < len && s[i + 1] == '\n')
+			continue;
+		s[n++] = (s[i] == '\r') ? '\n' : s[i];
+	}
+	len = n;
+	if (len == 0)
+		return;
+
+	if (E.cy == E.numrows)
+		editorInsertRow(E.cy, "", 0);
+	erow *row = ptRow(E.cy);
+
+	char *nl = memchr(s, '\n', len);
+	if (nl == NULL)
+	{
+		editorRowInsertString(row, E.cx, s, len);
+		E.cx += len;
+		return;
+	}
+
+	// the rows after the first are the rest of the text followed by
+	// whatever was right of the cursor
+	int first = nl - s;
+	int restlen = len - first - 1;
+	int taillen = row->size - E.cx;
+	char *rest = malloc(restlen + taillen + 1);
+	memcpy(rest, nl + 1, restlen);
+	memcpy(&rest[restlen], editorRowCharsFrom(row, E.cx), taillen);
+
+	char *last = memrchr(rest, '\n', restlen);
+	int lastlen = last ? restlen - (last + 1 - rest) : restlen;
+
+	editorRowTruncate(row, E.cx);
+	editorRowAppendString(ptRow(E.cy), s, first);
+	E.cy += editorInsertRows(E.cy + 1, rest, restlen + taillen);
+	E.cx = lastlen;
+	free(rest);
+}
+
 void editorDelChar()
 {
 	if (E.cy == E.numrows) return;
 	if (E.cx == 0 && E.cy == 0) return;
 
-	erow *row = &E.row[E.cy];
+	erow *row = ptRow(E.cy);
 	if (E.cx > 0)
 	{
 		editorRowDelChar(row, E.cx - 1);
@@ -45,8 +95,9 @@ void editorDelChar()
 	}
 	else
 	{
-		E.cx = E.row[E.cy - 1].size;
-		editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
+		erow *prev = ptRow(E.cy - 1);
+		E.cx = prev->size;
+		editorRowAppendString(prev, editorRowCharsFrom(row, 0), row->size);
 		editorDelRow(E.cy);
 		--E.cy;
 	}
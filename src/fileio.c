@@ -6,68 +6,336 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "../include/editor.h"
 #include "../include/highlight.h"
 #include "../include/row.h"
+#include "../include/ptable.h"
+#include "../include/fileio.h"
 #include "../include/output.h"
 #include "../include/input.h"
 #include "../include/terminal.h"
 
+#define KILO_SAVE_IOV 1024 // pieces of text written by one writev(), at most IOV_MAX
+#define KILO_SAVE_CHUNK (4 << 20) // bytes written between progress updates
+
 extern struct editorConfig E;
 
 /*** file i/o ***/
 
-char *editorRowsToString(int *buflen)
+/* Rows are not read from the file up front. It is mapped and indexed in the
+   background, and rows are added to the document as the indexer finds
+   them; they only become erows once they are drawn or edited. */
+void editorOpen(char *filename)
 {
-	int totlen = 0;
-	int j;
-	for (j = 0; j < E.numrows; ++j)
-		totlen += E.row[j].size + 1;
-	*buflen = totlen;
+	E.filename = strdup(filename);
 
-	char *buf = malloc(totlen);
-	char *p = buf;
-	for (j = 0; j < E.numrows; ++j)
+	editorSelectSyntaxHighlight();
+
+	if (ptOpen(filename) == -1)
+		die("open");
+	editorPollOpen();
+	E.dirty = 0;
+}
+
+void editorPollOpen()
+{
+	E.numrows += ptPoll();
+	E.loading = ptLoading();
+}
+
+void editorFinishOpen()
+{
+	if (!E.loading)
+		return;
+	E.numrows += ptFinishLoad();
+	E.loading = 0;
+}
+
+/*
+ * A save streams the document to a temporary file next to the original,
+ * syncs it and renames it over the original, so that the file on disk is
+ * always either the old or the new one. The text is not copied: rows and
+ * runs of unedited lines are handed to writev() where they lie, in batches
+ * of KILO_SAVE_IOV. The old file stays mapped after the rename, so unedited
+ * lines still point at valid text.
+ *
+ * The writing is done by a thread while editing goes on. It works from a
+ * snapshot of the document taken when the save starts: a list of the
+ * stretches of text it is made of. Unedited text lives in buffers that are
+ * not changed or freed while the file is open, so only the rows that were
+ * edited, whose text can change under the thread, are copied. Edits made
+ * during the save leave the document modified once it is done.
+ */
+
+struct saveSeg
+{
+	const char *s;
+	size_t len;
+	int span; // a run of unedited lines, see editorSaveSpan()
+};
+
+struct saveJob
+{
+	char *path;
+	char *tmp;
+	mode_t mode;
+	struct saveSeg *segs;
+	int nsegs;
+	char *copy; // the text of the edited rows
+	size_t total; // bytes in segs
+	size_t written; // so far, read by the UI thread
+	int dirty; // E.dirty when the snapshot was taken
+	int err; // errno of a save that failed, 0 when it succeeded
+	int done;
+};
+
+static struct saveJob *save = NULL;
+static pthread_t saver;
+
+struct saveBatch
+{
+	int fd;
+	struct iovec iov[KILO_SAVE_IOV];
+	int n;
+	size_t len; // bytes added so far
+	size_t flushed;
+	size_t *written; // flushed, for the UI thread
+};
+
+static int editorSaveFlush(struct saveBatch *b)
+{
+	struct iovec *v = b->iov;
+	int n = b->n;
+
+	while (n > 0)
 	{
-		memcpy(p, E.row[j].chars, E.row[j].size);
-		p += E.row[j].size;
-		*p = '\n';
-		p++;
+		ssize_t w = writev(b->fd, v, n);
+		if (w == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		// a short write leaves the rest of the batch to go again
+		while (n > 0 && (size_t)w >= v->iov_len)
+		{
+			w -= v->iov_len;
+			++v;
+			--n;
+		}
+		if (n > 0)
+		{
+			v->iov_base = (char *)v->iov_base + w;
+			v->iov_len -= w;
+		}
 	}
+	b->n = 0;
+	b->flushed = b->len;
+	__atomic_store_n(b->written, b->len, __ATOMIC_RELAXED);
+	return 0;
+}
 
-	return buf;
+/* Adds text to the batch. Long runs go out in pieces of KILO_SAVE_CHUNK,
+   so that the progress shown moves along. */
+static int editorSaveAdd(struct saveBatch *b, const char *s, size_t len)
+{
+	while (len > 0)
+	{
+		if ((b->n == KILO_SAVE_IOV || b->len - b->flushed >= KILO_SAVE_CHUNK) &&
+			editorSaveFlush(b) == -1)
+			return -1;
+		size_t n = (len < KILO_SAVE_CHUNK) ? len : KILO_SAVE_CHUNK;
+		b->iov[b->n].iov_base = (char *)s;
+		b->iov[b->n].iov_len = n;
+		b->n++;
+		b->len += n;
+		s += n;
+		len -= n;
+	}
+	return 0;
 }
 
-void editorOpen(char *filename)
+/* Adds a run of unedited lines, dropping the \r at the end of a line as
+   ptIterNext() does. */
+static int editorSaveSpan(struct saveBatch *b, const char *s, size_t len)
 {
-	E.filename = strdup(filename);
+	const char *end = s + len;
+	const char *cr;
 
-	editorSelectSyntaxHighlight();
+	while ((cr = memchr(s, '\r', end - s)) != NULL)
+	{
+		const char *e = cr;
+		while (e < end && *e == '\r')
+			++e;
+		if (editorSaveAdd(b, s, (e == end || *e == '\n') ? cr - s : e - s) == -1)
+			return -1;
+		s = e;
+	}
+	return editorSaveAdd(b, s, end - s);
+}
 
-	FILE *fp = fopen(filename, "r");
-	if (!fp)
-		die("fopen");
+static int editorSaveWrite(struct saveJob *j, int fd)
+{
+	static const char nl = '\n';
+	struct saveBatch *b = malloc(sizeof(struct saveBatch));
+	b->fd = fd;
+	b->n = 0;
+	b->len = 0;
+	b->flushed = 0;
+	b->written = &j->written;
 
-	char *line = NULL;
-	size_t linecap = 0;
-	ssize_t linelen;
-	while ((linelen = getline(&line, &linecap, fp)) != -1)
+	int ret = 0;
+	for (int i = 0; ret == 0 && i < j->nsegs; ++i)
 	{
-		while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-			--linelen;
-		editorInsertRow(E.numrows, line, linelen);
+		struct saveSeg *seg = &j->segs[i];
+		if (seg->span)
+			ret = editorSaveSpan(b, seg->s, seg->len);
+		else
+			ret = editorSaveAdd(b, seg->s, seg->len);
+		if (ret == 0)
+			ret = editorSaveAdd(b, &nl, 1);
 	}
-	free(line);
-	fclose(fp);
-	E.dirty = 0;
+	if (ret == 0)
+		ret = editorSaveFlush(b);
+
+	free(b);
+	return ret;
+}
+
+/* Makes the rename of a file in the directory of path durable. */
+static void editorSyncDir(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd != -1)
+	{
+		fsync(fd);
+		close(fd);
+	}
+	free(dir);
+}
+
+static void *editorSaveWorker(void *arg)
+{
+	struct saveJob *j = arg;
+
+	int fd = mkstemp(j->tmp);
+	int ok = fd != -1 &&
+		fchmod(fd, j->mode) == 0 &&
+		editorSaveWrite(j, fd) == 0 &&
+		fsync(fd) == 0;
+	if (fd != -1)
+		ok = (close(fd) == 0) && ok;
+	ok = ok && rename(j->tmp, j->path) == 0;
+
+	if (ok)
+		editorSyncDir(j->path);
+	else
+	{
+		j->err = errno;
+		if (fd != -1)
+			unlink(j->tmp);
+	}
+	__atomic_store_n(&j->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* Lists the text of the document for a save. Only edited rows are copied. */
+static void editorSaveSnapshot(struct saveJob *j)
+{
+	ptiter it;
+	erow *row;
+	char *s;
+	size_t len;
+	int n;
+
+	size_t copied = 0;
+	ptIterInit(&it, 0);
+	while (ptIterSpan(&it, &row, &s, &len, &n))
+	{
+		++j->nsegs;
+		if (row && row->owned)
+			copied += row->size;
+	}
+	j->segs = malloc(sizeof(struct saveSeg) * (j->nsegs + 1));
+	j->copy = malloc(copied + 1);
+
+	char *p = j->copy;
+	int i = 0;
+	ptIterInit(&it, 0);
+	while (ptIterSpan(&it, &row, &s, &len, &n))
+	{
+		struct saveSeg *seg = &j->segs[i++];
+		seg->span = (row == NULL);
+		if (row)
+		{
+			len = row->size;
+			s = editorRowCharsFrom(row, 0);
+			if (row->owned)
+			{
+				s = memcpy(p, s, len);
+				p += len;
+			}
+		}
+		seg->s = s;
+		seg->len = len;
+		j->total += len + 1;
+	}
+}
+
+/* Takes in the result of the save, whose thread has finished. */
+static void editorSaveDone()
+{
+	if (save->err == 0)
+	{
+		E.dirty -= save->dirty;
+		editorSetStatusMessage("%zu bytes written to disk", save->written);
+	}
+	else
+		editorSetStatusMessage("Can't save! I/O error: %s", strerror(save->err));
+
+	free(save->path);
+	free(save->tmp);
+	free(save->segs);
+	free(save->copy);
+	free(save);
+	save = NULL;
+}
+
+void editorPollSave()
+{
+	if (save && __atomic_load_n(&save->done, __ATOMIC_ACQUIRE))
+	{
+		pthread_join(saver, NULL);
+		editorSaveDone();
+	}
+
+	E.saving = (save != NULL);
+	if (save)
+		E.saved = save->total ?
+			__atomic_load_n(&save->written, __ATOMIC_RELAXED) * 100 / save->total : 0;
+}
+
+/* Waits for the save in progress. */
+void editorFinishSave()
+{
+	if (save == NULL)
+		return;
+	pthread_join(saver, NULL);
+	editorSaveDone();
+	E.saving = 0;
 }
 
 void editorSave()
 {
 	if (E.filename == NULL)
 	{
-		E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
+		E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL, 0);
 		if (E.filename == NULL)
 		{
 			editorSetStatusMessage("Save aborted");
@@ -76,26 +344,37 @@ void editorSave()
 		editorSelectSyntaxHighlight();
 	}
 
-	int len;
-	char *buf = editorRowsToString(&len);
+	editorFinishOpen();
+	editorFinishSave();
 
-	int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-	if (fd != -1)
+	struct saveJob *j = calloc(1, sizeof(struct saveJob));
+
+	// a symlink is followed, so that the file it points to is replaced
+	j->path = realpath(E.filename, NULL);
+	if (j->path == NULL)
+		j->path = strdup(E.filename);
+
+	struct stat st;
+	if (stat(j->path, &st) == 0)
+		j->mode = st.st_mode & 07777;
+	else
 	{
-		if (ftruncate(fd, len) != -1)
-		{
-			if (write(fd, buf, len) == len)
-			{
-				close(fd);
-				free(buf);
-				E.dirty = 0;
-				editorSetStatusMessage("%d bytes written to disk", len);
-				return;
-			}
-		}
-		close(fd);
+		mode_t mask = umask(0);
+		umask(mask);
+		j->mode = 0644 & ~mask;
 	}
 
-	free(buf);
-	editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+	j->tmp = malloc(strlen(j->path) + 8);
+	sprintf(j->tmp, "%s.XXXXXX", j->path);
+	j->dirty = E.dirty;
+	editorSaveSnapshot(j);
+
+	save = j;
+	if (pthread_create(&saver, NULL, editorSaveWorker, j) != 0)
+	{
+		// saved on this thread then
+		editorSaveWorker(j);
+		editorSaveDone();
+	}
+	editorPollSave();
 }
@@ -1,83 +1,608 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "../include/editor.h"
 #include "../include/row.h"
+#include "../include/ptable.h"
 #include "../include/highlight.h"
 #include "../include/input.h"
+#include "../include/fileio.h"
+#include "../include/scan.h"
+#include "../include/regex.h"
+#include "../include/output.h"
+#include "../include/terminal.h"
+
+#define KILO_FIND_STEP 64 // rows between matches still walked to rather than sought
+#define KILO_FIND_PART (1 << 20) // bytes of text searched as one piece of work
+#define KILO_FIND_THREADS 64
+#define KILO_FIND_WAIT_MS 50 // spent on a search before it goes on in the background
 
 extern struct editorConfig E;
 
+/*
+ * A search keeps every match of the query in document order, as row and
+ * column in the row's chars. The text is searched where it lies: runs of
+ * rows that were never materialized are searched as one stretch of the
+ * file with scanFind(). When a character is added to the query, only the
+ * old matches are checked again, since the new ones are among them.
+ * Matches may overlap, so that this holds.
+ *
+ * Ctrl-R switches to searching for a regular expression. The lines that
+ * hold a match are found in the same stretches of text with reFindLine(),
+ * and the matches in them, which do not overlap, with reMatchAll().
+ *
+ * The text is cut at line ends into parts of about KILO_FIND_PART bytes,
+ * which a pool of threads, one less than there are cores, and the UI
+ * thread take in turn. A part's matches have rows counted from its first
+ * line, and editorPollFind() takes over the parts that are done in order.
+ * The UI thread waits for a search for a short while, after which it goes
+ * on in the background until it finishes or the query changes.
+ */
+
+struct findMatch
+{
+	int row;
+	int col;
+	int len;
+};
+
+struct findList
+{
+	struct findMatch *m;
+	int n;
+	int cap;
+};
+
+struct findPart
+{
+	const char *s;
+	size_t len;
+	char *copy; // s, when it is the text of a row the UI thread may change
+	int rows; // lines in s, once done
+	struct findList found;
+	int done;
+};
+
+struct findJob
+{
+	char *query;
+	int qlen;
+	int regex;
+	struct findPart *parts;
+	int nparts;
+	int next; // first part no thread has taken yet
+	int finished; // parts done
+	int workers; // pool threads still on the job
+	int cancel;
+};
+
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int nthreads;
+	struct findJob *job;
+	unsigned int gen; // of job
+} pool =
+{
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static struct
+{
+	char *query;
+	int qlen;
+	int regex; // the matches are those of a regex
+	struct findList found;
+	int current; // -1 until one is chosen
+	int fromrow, fromcol; // where the search started
+	int hlrow; // row showing the current match, -1 when none does
+	struct findJob *job; // still searching
+	int absorbed; // parts of the job taken over
+	int rows; // in those parts
+} F = { .hlrow = -1 };
+
+/*** matching ***/
+
+static void editorFindAdd(struct findList *l, int row, int col, int len)
+{
+	if (l->n == l->cap)
+	{
+		l->cap = l->cap ? l->cap * 2 : 256;
+		l->m = realloc(l->m, sizeof(struct findMatch) * l->cap);
+	}
+	l->m[l->n].row = row;
+	l->m[l->n].col = col;
+	l->m[l->n].len = len;
+	l->n++;
+}
+
+/* Adds the matches in s, which holds lines separated by newlines, with rows
+   counted from its first. Returns the number of lines. */
+static int editorFindIn(struct findList *l, const char *s, size_t len,
+	const char *q, int qlen)
+{
+	const char *end = s + len;
+	const char *line = s; // start of 'row'
+	const char *p = s;
+	int row = 0;
+
+	while ((p = scanFind(p, end - p, q, qlen)) != NULL)
+	{
+		size_t lines = scanCountLines(line, p - line);
+		if (lines)
+		{
+			row += lines;
+			line = (const char *)memrchr(line, '\n', p - line) + 1;
+		}
+		editorFindAdd(l, row, p - line, qlen);
+		++p;
+	}
+	return row + scanCountLines(line, end - line) + 1;
+}
+
+/* A line being searched by editorFindRegexIn(). */
+struct findLine
+{
+	struct findList *l;
+	int row;
+};
+
+static void editorFindRegexAdd(void *arg, int col, int len)
+{
+	struct findLine *line = arg;
+	editorFindAdd(line->l, line->row, col, len);
+}
+
+/* The same for a regex. */
+static int editorFindRegexIn(struct findList *l, regex *re, const char *s, size_t len)
+{
+	const char *end = s + len;
+	const char *line = s;
+	const char *p = s;
+	int row = 0;
+
+	while ((p = reFindLine(re, p, end - p)) != NULL)
+	{
+		row += scanCountLines(line, p - line);
+		line = p;
+
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+			eol = end;
+		int llen = eol - p;
+		while (llen > 0 && p[llen - 1] == '\r')
+			--llen;
+
+		struct findLine found = { l, row };
+		reMatchAll(re, p, llen, editorFindRegexAdd, &found);
+
+		if (eol == end)
+			break;
+		p = eol + 1;
+	}
+	return row + scanCountLines(line, end - line) + 1;
+}
+
+/* Keeps the matches of the old query that the longer q also matches. */
+static void editorFindRefine(const char *q, int qlen)
+{
+	ptiter it;
+	int at = -1;
+	char *s = NULL;
+	int len = 0;
+	int kept = 0;
+
+	for (int i = 0; i < F.found.n; ++i)
+	{
+		struct findMatch m = F.found.m[i];
+		if (m.row != at)
+		{
+			// nearby rows are walked to, anything further is sought
+			if (at < 0 || m.row - at > KILO_FIND_STEP)
+			{
+				ptIterInit(&it, m.row);
+				at = m.row - 1;
+			}
+			while (at < m.row)
+			{
+				erow *row;
+				ptIterNext(&it, &row, &s, &len);
+				if (row)
+				{
+					len = row->size;
+					s = editorRowCharsFrom(row, 0);
+				}
+				++at;
+			}
+		}
+		if (m.col + qlen <= len && memcmp(&s[m.col], q, qlen) == 0)
+		{
+			m.len = qlen;
+			F.found.m[kept++] = m;
+		}
+	}
+	F.found.n = kept;
+}
+
+/* Returns the first match at or after row, col, or -1 if there is none. */
+static int editorFindFrom(int row, int col)
+{
+	int lo = 0, hi = F.found.n;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		struct findMatch *m = &F.found.m[mid];
+		if (m->row < row || (m->row == row && m->col < col))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < F.found.n) ? lo : -1;
+}
+
+/*** searching ***/
+
+static void editorFindDeadline(struct timespec *ts, int ms)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_nsec += (long)ms * 1000000;
+	ts->tv_sec += ts->tv_nsec / 1000000000;
+	ts->tv_nsec %= 1000000000;
+}
+
+static int editorFindPast(const struct timespec *ts)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec > ts->tv_sec ||
+		(now.tv_sec == ts->tv_sec && now.tv_nsec >= ts->tv_nsec);
+}
+
+/* Searches the parts of j that no thread has taken yet, until there are
+   none left or 'until' has passed, when it is given. */
+static void editorFindWork(struct findJob *j, const struct timespec *until)
+{
+	regex *re = j->regex ? reCompile(j->query) : NULL;
+
+	while (!__atomic_load_n(&j->cancel, __ATOMIC_RELAXED))
+	{
+		if (until && editorFindPast(until))
+			break;
+		int i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED);
+		if (i >= j->nparts)
+			break;
+
+		struct findPart *p = &j->parts[i];
+		if (re)
+			p->rows = editorFindRegexIn(&p->found, re, p->s, p->len);
+		else
+			p->rows = editorFindIn(&p->found, p->s, p->len, j->query, j->qlen);
+		__atomic_store_n(&p->done, 1, __ATOMIC_RELEASE);
+
+		if (__atomic_add_fetch(&j->finished, 1, __ATOMIC_ACQ_REL) == j->nparts)
+		{
+			pthread_mutex_lock(&pool.lock);
+			pthread_cond_broadcast(&pool.cond);
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+	reFree(re);
+}
+
+static void *editorFindWorker(void *arg)
+{
+	unsigned int seen = 0;
+	while (1)
+	{
+		pthread_mutex_lock(&pool.lock);
+		while (pool.job == NULL || pool.gen == seen)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		struct findJob *j = pool.job;
+		seen = pool.gen;
+		++j->workers;
+		pthread_mutex_unlock(&pool.lock);
+
+		editorFindWork(j, NULL);
+
+		pthread_mutex_lock(&pool.lock);
+		--j->workers;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+	return NULL;
+}
+
+static struct findPart *editorFindPart(struct findJob *j, const char *s, size_t len)
+{
+	if ((j->nparts & (j->nparts - 1)) == 0)
+		j->parts = realloc(j->parts, sizeof(struct findPart) *
+			(j->nparts ? j->nparts * 2 : 1));
+	struct findPart *p = &j->parts[j->nparts++];
+	memset(p, 0, sizeof(struct findPart));
+	p->s = s;
+	p->len = len;
+	return p;
+}
+
+/* Takes the job from the pool, and waits for its threads to let go of it. */
+static void editorFindRelease(struct findJob *j)
+{
+	pthread_mutex_lock(&pool.lock);
+	if (pool.job == j)
+		pool.job = NULL;
+	while (j->workers > 0)
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < j->nparts; ++i)
+	{
+		free(j->parts[i].copy);
+		free(j->parts[i].found.m);
+	}
+	free(j->parts);
+	free(j->query);
+	free(j);
+}
+
+/* Cancels the search in progress. */
+static void editorFindStop()
+{
+	if (F.job == NULL)
+		return;
+	__atomic_store_n(&F.job->cancel, 1, __ATOMIC_RELAXED);
+	editorFindRelease(F.job);
+	F.job = NULL;
+}
+
+/* Takes over the parts that are done, up to the first that is not. */
+static void editorFindAbsorb()
+{
+	struct findJob *j = F.job;
+	while (F.absorbed < j->nparts &&
+		__atomic_load_n(&j->parts[F.absorbed].done, __ATOMIC_ACQUIRE))
+	{
+		struct findPart *p = &j->parts[F.absorbed++];
+		for (int i = 0; i < p->found.n; ++i)
+			editorFindAdd(&F.found, F.rows + p->found.m[i].row, p->found.m[i].col,
+				p->found.m[i].len);
+		F.rows += p->rows;
+		free(p->found.m);
+		p->found.m = NULL;
+	}
+
+	if (F.absorbed == j->nparts)
+	{
+		editorFindRelease(j);
+		F.job = NULL;
+	}
+}
+
+static void editorFindStart(const char *q, int qlen)
+{
+	struct findJob *j = calloc(1, sizeof(struct findJob));
+	j->query = strdup(q);
+	j->qlen = qlen;
+	j->regex = E.regex;
+
+	// unedited text lives in buffers that are not freed while the file is open
+	ptiter it;
+	ptIterInit(&it, 0);
+	erow *row;
+	char *s;
+	size_t len;
+	int n;
+	while (ptIterSpan(&it, &row, &s, &len, &n))
+	{
+		if (row)
+		{
+			len = row->size;
+			s = editorRowCharsFrom(row, 0);
+			struct findPart *p = editorFindPart(j, s, len);
+			if (row->owned)
+				p->s = p->copy = memcpy(malloc(len + 1), s, len);
+			continue;
+		}
+
+		char *cut;
+		while (len > KILO_FIND_PART &&
+			(cut = memchr(&s[KILO_FIND_PART], '\n', len - KILO_FIND_PART)) != NULL)
+		{
+			editorFindPart(j, s, cut - s);
+			len -= cut + 1 - s;
+			s = cut + 1;
+		}
+		editorFindPart(j, s, len);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.nthreads == 0)
+	{
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		pool.nthreads = (cores < 2) ? 1 :
+			(cores > KILO_FIND_THREADS) ? KILO_FIND_THREADS - 1 : cores - 1;
+		for (int i = 0; i < pool.nthreads; ++i)
+		{
+			pthread_t t;
+			pthread_create(&t, NULL, editorFindWorker, NULL);
+			pthread_detach(t);
+		}
+	}
+	pool.job = j;
+	++pool.gen;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	F.job = j;
+	F.absorbed = 0;
+	F.rows = 0;
+
+	struct timespec until;
+	editorFindDeadline(&until, KILO_FIND_WAIT_MS);
+	editorFindWork(j, &until);
+
+	pthread_mutex_lock(&pool.lock);
+	while (__atomic_load_n(&j->finished, __ATOMIC_ACQUIRE) < j->nparts)
+		if (pthread_cond_timedwait(&pool.cond, &pool.lock, &until) == ETIMEDOUT)
+			break;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* Searches what is left of the search in progress, and takes it over. */
+static void editorFindFinish()
+{
+	if (F.job == NULL)
+		return;
+	editorFindWork(F.job, NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	while (__atomic_load_n(&F.job->finished, __ATOMIC_ACQUIRE) < F.job->nparts)
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+	editorFindAbsorb();
+}
+
 /*** find ***/
 
-void editorFindCallback(char *query, int key)
+static void editorFindClear()
 {
-	static int last_match = -1;
-	static int direction = 1;
+	editorFindStop();
+	free(F.query);
+	F.query = NULL;
+	F.qlen = 0;
+	F.found.n = 0;
+	E.matches = -1;
+	E.searching = 0;
+}
+
+/* Moves to the match and highlights it. */
+static void editorFindMark(struct findMatch m)
+{
+	erow *row = editorRow(m.row);
+	E.cy = m.row;
+	E.cx = m.col;
+	E.rowoff = E.numrows;
 
-	static int saved_hl_line;
-	static char *saved_hl = NULL;
+	int rx = editorRowCxToRx(row, m.col);
+	int end = editorRowCxToRx(row, m.col + m.len);
+	memset(&row->hl[rx], HL_MATCH, end - rx);
+	F.hlrow = m.row;
+}
 
-	if (saved_hl)
+/* Unhighlights the match shown. */
+static void editorFindUnmark()
+{
+	if (F.hlrow != -1)
 	{
-		memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize);
-		free(saved_hl);
-		saved_hl = NULL;
+		// the row is highlighted again when it is next drawn
+		editorInvalidateRow(ptRow(F.hlrow));
+		F.hlrow = -1;
 	}
+}
+
+/* Takes over what the search has found so far, and moves to the current
+   match once there is one. */
+static void editorFindShow()
+{
+	if (F.job)
+		editorFindAbsorb();
+	E.searching = (F.job != NULL);
+
+	if (F.current < 0)
+	{
+		F.current = editorFindFrom(F.fromrow, F.fromcol);
+		if (F.current < 0 && F.job == NULL && F.found.n > 0)
+			F.current = 0;
+	}
+
+	E.matches = (F.qlen > 0) ? F.found.n : -1;
+	E.match = F.current + 1;
+	if (F.current < 0 || F.hlrow != -1)
+		return;
+	editorFindMark(F.found.m[F.current]);
+}
+
+void editorPollFind()
+{
+	if (F.job)
+		editorFindShow();
+}
+
+void editorFindCallback(char *query, int key)
+{
+	editorFindUnmark();
 
 	if (key == '\r' || key == '\x1b')
 	{
-		last_match = -1;
-		direction = 1;
+		editorFindClear();
 		return;
 	}
-	else if (key == ARROW_RIGHT || key == ARROW_DOWN)
-		direction = 1;
-	else if (key == ARROW_LEFT || key == ARROW_UP)
-		direction = -1;
-	else
+
+	if (key == CTRL_KEY('r'))
 	{
-		last_match = -1;
-		direction = 1;
+		E.regex = !E.regex;
+		free(F.query);
+		F.query = NULL;
 	}
 
-	if (last_match == -1)
-		direction = 1;
-	int current = last_match;
-	for (int i = 0; i < E.numrows; ++i)
+	int qlen = strlen(query);
+	if (F.query == NULL || strcmp(query, F.query) != 0)
 	{
-		current += direction;
-		if (current == -1)
-			current = E.numrows - 1;
-		else if (current == E.numrows)
-			current = 0;
+		// only a search that finished has all the matches to refine
+		int refine = !E.regex && !F.regex && F.job == NULL && F.query &&
+			qlen > F.qlen && !strncmp(query, F.query, F.qlen);
+		editorFindStop();
 
-		erow *row = &E.row[current];
-		char *match = strstr(row->render, query);
-		if (match)
+		regex *re = NULL;
+		if (qlen == 0 || (E.regex && (re = reCompile(query)) == NULL))
+			F.found.n = 0; // a regex may not be valid yet
+		else if (refine)
+			editorFindRefine(query, qlen);
+		else
 		{
-			last_match = current;
-			E.cy = current;
-			E.cx = editorRowRxToCx(row, match - row->render);
-			E.rowoff = E.numrows;
-
-			saved_hl_line = current;
-			saved_hl = malloc(row->rsize);
-			memcpy(saved_hl, row->hl, row->rsize);
-			memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-			break;
+			F.found.n = 0;
+			editorFindStart(query, qlen);
 		}
+		reFree(re);
+
+		free(F.query);
+		F.query = strdup(query);
+		F.qlen = qlen;
+		F.regex = E.regex;
+		F.current = -1;
+	}
+	else if (F.found.n > 0 && (key == ARROW_RIGHT || key == ARROW_DOWN))
+	{
+		F.current = (F.current + 1) % F.found.n;
 	}
+	else if (F.found.n > 0 && (key == ARROW_LEFT || key == ARROW_UP))
+	{
+		F.current = (F.current > 0) ? F.current - 1 : F.found.n - 1;
+	}
+
+	editorFindShow();
 }
 
 void editorFind()
 {
+	editorFinishOpen();
+
 	int saved_cx = E.cx;
 	int saved_cy = E.cy;
 	int saved_coloff = E.coloff;
 	int saved_rowoff = E.rowoff;
 
-	char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter)",
-								editorFindCallback);
+	F.fromrow = E.cy;
+	F.fromcol = E.cx;
+	char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter, Ctrl-R = regex)",
+								editorFindCallback, 0);
 
 	if (query)
 		free(query);
@@ -88,4 +613,153 @@ void editorFind()
 		E.coloff = saved_coloff;
 		E.rowoff = saved_rowoff;
 	}
+}
+
+/*** replace ***/
+
+/*
+ * A replace is a search whose matches are all found before anything is
+ * changed. Matches of a literal query may overlap, so they are taken left
+ * to right, skipping those that overlap one already taken. The text put in
+ * their place is literal, also for a regex. All of them are replaced with
+ * one editorRowsReplace(), which rewrites each row once and is undone as a
+ * whole.
+ */
+
+/* Shows the question and returns the key that answers it. */
+static int editorReplaceAsk(const char *fmt, ...)
+{
+	char msg[80];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	while (1)
+	{
+		editorSetStatusMessage("%s", msg);
+		editorPollHighlight();
+		editorRefreshScreen();
+
+		int c = editorReadKey();
+		if (c == PASTE_START)
+		{
+			int len;
+			free(editorReadPaste(&len));
+		}
+		else if (c != -1 && c != MOUSE_EVENT)
+			return c;
+	}
+}
+
+static void editorReplaceCallback(char *query, int key)
+{
+	if (key != '\r')
+	{
+		editorFindCallback(query, key);
+		return;
+	}
+	editorFindUnmark();
+	editorFindFinish();
+	editorFindShow();
+}
+
+/* Asks about each match in turn, from the current one on, and drops those
+   that are not to be replaced. Returns how many are left. */
+static int editorReplaceConfirm(struct rowEdit *edits, int n)
+{
+	int first = 0;
+	if (F.current >= 0)
+	{
+		struct findMatch m = F.found.m[F.current];
+		while (first < n && (edits[first].row < m.row ||
+			(edits[first].row == m.row && edits[first].col < m.col)))
+			++first;
+		first %= n;
+	}
+
+	char *pick = calloc(n, 1);
+	for (int k = 0; k < n; ++k)
+	{
+		int i = (first + k) % n;
+		struct findMatch m = { edits[i].row, edits[i].col, edits[i].len };
+		editorFindMark(m);
+		int c = editorReplaceAsk("Replace %d of %d? (y)es, (n)o, (a)ll the rest, (q)uit",
+			k + 1, n);
+		editorFindUnmark();
+
+		if (c == 'y')
+			pick[i] = 1;
+		else if (c == 'a')
+		{
+			for (; k < n; ++k)
+				pick[(first + k) % n] = 1;
+		}
+		else if (c == 'q' || c == '\x1b')
+			break;
+		else if (c != 'n')
+			--k; // asked again
+	}
+
+	int kept = 0;
+	for (int i = 0; i < n; ++i)
+		if (pick[i])
+			edits[kept++] = edits[i];
+	free(pick);
+	return kept;
+}
+
+void editorReplace()
+{
+	editorFinishOpen();
+
+	int saved_cx = E.cx;
+	int saved_cy = E.cy;
+	int saved_coloff = E.coloff;
+	int saved_rowoff = E.rowoff;
+
+	F.fromrow = E.cy;
+	F.fromcol = E.cx;
+	char *query = editorPrompt("Replace: %s (Use ESC/Arrows/Enter, Ctrl-R = regex)",
+								editorReplaceCallback, 0);
+	editorFindUnmark();
+	char *with = query ? editorPrompt("Replace with: %s (ESC to cancel)", NULL, 1) : NULL;
+
+	if (with)
+	{
+		int withlen = strlen(with);
+		struct rowEdit *edits = malloc(sizeof(struct rowEdit) * (F.found.n + 1));
+		int n = 0;
+		int prevrow = -1, prevend = 0;
+		for (int i = 0; i < F.found.n; ++i)
+		{
+			struct findMatch m = F.found.m[i];
+			if (m.row == prevrow && m.col < prevend)
+				continue;
+			edits[n++] = (struct rowEdit){ m.row, m.col, m.len, with, withlen };
+			prevrow = m.row;
+			prevend = m.col + m.len;
+		}
+
+		if (n == 0)
+			editorSetStatusMessage("No matches");
+		else
+		{
+			int c = editorReplaceAsk("Replace %d matches? (a)ll, (c)onfirm each, ESC to cancel", n);
+			int kept = (c == 'a') ? n : (c == 'c') ? editorReplaceConfirm(edits, n) : 0;
+			editorRowsReplace(edits, kept);
+			editorSetStatusMessage("Replaced %d of %d", kept, n);
+		}
+		free(edits);
+		free(with);
+	}
+	free(query);
+	editorFindClear();
+
+	E.cx = saved_cx;
+	E.cy = saved_cy;
+	E.coloff = saved_coloff;
+	E.rowoff = saved_rowoff;
+	if (E.cy < E.numrows && E.cx > ptRow(E.cy)->size)
+		E.cx = ptRow(E.cy)->size;
 }
\ No newline at end of file
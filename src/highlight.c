@@ -1,239 +1,513 @@
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <pthread.h>
 
 #include "../include/editor.h"
 #include "../include/highlight.h"
+#include "../include/ptable.h"
+#include "../include/kwtable.h"
+#include "../include/syntax.h"
 
 extern struct editorConfig E;
 
-#define HL_HIGHLIGHT_NUMBERS (1 << 0)
-#define HL_HIGHLIGHT_STRINGS (1 << 1)
+/*** syntax highlighting ***/
 
-char *C_HL_extensions[] = { ".c", ".h", ".cpp", NULL };
-char *C_HL_keywords[] =
+static int has_prefix(const char *s, int len, const char *prefix, int plen)
 {
-	"switch", "if", "while", "for", "break", "continue", "return", "else",
-	"default",
-
-	"int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-	"void|", "struct|", "union|", "typedef|", "static|", "enum|", NULL
-};
+	return plen <= len && !memcmp(s, prefix, plen);
+}
 
-struct editorSyntax HLDB[] =
+/* Returns how a word is highlighted if it is a keyword, HL_NORMAL if not. */
+static int editorKeyword(const struct kwtable *kw, const char *s, int len)
 {
-	{
-		"c",
-		C_HL_extensions,
-		C_HL_keywords,
-		"//", "/*", "*/",
-		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
-	},
-};
-
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+	if (len == 0 || len > kw->maxlen)
+		return HL_NORMAL;
 
-/*** syntax highlighting ***/
+	const struct kwentry *e = &kw->slots[kwHash(kw->seed, s, len) & kw->mask];
+	if (e->len == len && !memcmp(e->word, s, len))
+		return e->hl;
+	return HL_NORMAL;
+}
 
-static int is_separator(int c)
+/* Returns where the first end of block b is in s[from, len), or -1. */
+static int editorBlockEnd(struct editorBlock *b, const char *s, int from, int len)
 {
-	return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+	while (from + b->elen <= len)
+	{
+		const char *p = memchr(&s[from], b->end[0], len - from - b->elen + 1);
+		if (p == NULL)
+			return -1;
+		from = p - s;
+		if (!memcmp(p, b->end, b->elen))
+			return from;
+		++from;
+	}
+	return -1;
 }
 
-void editorUpdateSyntax(erow *row)
+static void editorMark(unsigned char *hl, int from, int to, int color)
 {
-	row->hl = realloc(row->hl, row->rsize);
-	memset(row->hl, HL_NORMAL, row->rsize);
-
-	if (E.syntax == NULL)
-		return;
-	
-	char **keywords = E.syntax->keywords;
+	if (hl)
+		memset(&hl[from], color, to - from);
+}
 
-	char *scs = E.syntax->singleline_comment_start;
-	char *mcs = E.syntax->multiline_comment_start;
-	char *mce = E.syntax->multiline_comment_end;
+/* Highlights one line of text into hl, which has room for len bytes, and
+   returns the state the line ends in, see struct editorBlock. Tabs do not
+   change it, so the lexer runs on render for drawing and on the raw text,
+   with hl NULL, when only the state is needed.
 
+   Bytes are classified by the table of the syntax, so runs of plain text and
+   of separators are stepped over without looking at the rules one by one,
+   and only the bytes that may start a comment or string are checked
+   against them. */
+static int editorLex(struct editorSyntax *syntax, const char *s, int len,
+	unsigned char *hl, int state)
+{
+	const unsigned char *cls = syntax->cls;
+	const unsigned char *u = (const unsigned char *)s;
+	char *scs = syntax->singleline_comment_start;
 	int scs_len = scs ? strlen(scs) : 0;
-	int mcs_len = mcs ? strlen(mcs) : 0;
-	int mce_len = mce ? strlen(mce) : 0;
+
+	editorMark(hl, 0, len, HL_NORMAL);
 
 	int prev_sep = 1;
-	int in_string = 0;
-	int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
+	int in_number = 0;
 
 	int i = 0;
-	while (i < row->rsize)
+	while (i < len)
 	{
-		char c = row->render[i];
-		unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
-
-		if (scs_len && !in_string && !in_comment)
+		if (state > 0)
 		{
-			if (!strncmp(&row->render[i], scs, scs_len))
+			struct editorBlock *b = &syntax->blocks[state - 1];
+			int end = editorBlockEnd(b, s, i, len);
+			if (end < 0)
 			{
-				memset(&row->hl[i], HL_COMMENT, row->rsize - i);
+				editorMark(hl, i, len, b->hl);
 				break;
 			}
+			editorMark(hl, i, end + b->elen, b->hl);
+			i = end + b->elen;
+			state = 0;
+			prev_sep = 1;
+			in_number = 0;
+			continue;
 		}
 
-		if (mcs_len && mce_len && !in_string)
+		int c = u[i];
+		int k = cls[c];
+
+		if (k & LX_START)
 		{
-			if (in_comment)
+			if (scs_len && c == scs[0] && has_prefix(&s[i], len - i, scs, scs_len))
 			{
-				row->hl[i] = HL_MLCOMMENT;
-				if (!strncmp(&row->render[i], mce, mce_len))
-				{
-					memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-					i += mce_len;
-					in_comment = 0;
-					prev_sep = 1;
-					continue;
-				}
-				else
-				{
-					++i;
-					continue;
-				}
+				editorMark(hl, i, len, HL_COMMENT);
+				break;
 			}
-			else if (!strncmp(&row->render[i], mcs, mcs_len))
+
+			int j;
+			for (j = 0; j < syntax->nblocks; ++j)
 			{
-				memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-				i += mcs_len;
-				in_comment = 1;
-				continue;
+				struct editorBlock *b = &syntax->blocks[j];
+				if (c == b->start[0] && has_prefix(&s[i], len - i, b->start, b->slen))
+					break;
 			}
-		}
-
-		if (E.syntax->flags & HL_HIGHLIGHT_STRINGS)
-		{
-			if (in_string)
+			if (j < syntax->nblocks)
 			{
-				row->hl[i] = HL_STRING;
-				if (c == '\\' && i + 1 < row->rsize)
-				{
-					row->hl[i + 1] = HL_STRING;
-					i += 2;
-					continue;
-				}
-				if (c == in_string) in_string = 0;
-				++i;
-				prev_sep = 1;
+				editorMark(hl, i, i + syntax->blocks[j].slen, syntax->blocks[j].hl);
+				i += syntax->blocks[j].slen;
+				state = j + 1;
+				in_number = 0;
 				continue;
 			}
-			else
+
+			if (k & LX_QUOTE)
 			{
-				if (c == '"' || c == '\'')
+				int end = i + 1;
+				while (end < len)
 				{
-					in_string = c;
-					row->hl[i] = HL_STRING;
-					++i;
-					continue;
+					if (u[end] == '\\' && end + 1 < len)
+						end += 2;
+					else if (u[end++] == c)
+						break;
 				}
+				editorMark(hl, i, end, HL_STRING);
+				if (end > i + 1)
+					prev_sep = 1;
+				i = end;
+				in_number = 0;
+				continue;
 			}
 		}
 
-		if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS)
+		if ((k & LX_DIGIT) ? (prev_sep || in_number) : ((k & LX_NUM) && in_number))
 		{
-			if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
-				(c == '.' && prev_hl == HL_NUMBER))
+			int end = i + 1;
+			while (end < len && (cls[u[end]] & (LX_NUM | LX_START)) == LX_NUM)
+				++end;
+			editorMark(hl, i, end, HL_NUMBER);
+			i = end;
+			prev_sep = 0;
+			in_number = 1;
+			continue;
+		}
+		in_number = 0;
+
+		if (prev_sep && (hl || syntax->kwstart))
+		{
+			int wlen = 0;
+			while (i + wlen < len && !(cls[u[i + wlen]] & LX_SEP))
+				++wlen;
+
+			int kw = editorKeyword(syntax->keywords, &s[i], wlen);
+			if (kw != HL_NORMAL)
 			{
-				row->hl[i] = HL_NUMBER;
-				++i;
+				editorMark(hl, i, i + wlen, kw);
+				i += wlen;
 				prev_sep = 0;
 				continue;
 			}
 		}
 
-		if (prev_sep)
+		// a run of separators, or of plain text, leaves everything as it is
+		// after its first byte
+		++i;
+		if (k & LX_SEP)
 		{
-			int j;
-			for (j = 0; keywords[j]; ++j)
-			{
-				int klen = strlen(keywords[j]);
-				int kw2 = keywords[j][klen - 1] == '|';
-				if (kw2) --klen;
+			prev_sep = 1;
+			while (i < len && (cls[u[i]] & (LX_SEP | LX_START | LX_DIGIT)) == LX_SEP)
+				++i;
+		}
+		else
+		{
+			prev_sep = 0;
+			while (i < len && !(cls[u[i]] & (LX_SEP | LX_START)))
+				++i;
+		}
+	}
+
+	return state;
+}
+
+/*** highlight state ***/
+
+/*
+ * hlstates[i] is the state row i starts in, see struct editorBlock. The
+ * entries up to hlrows are right. Rows from hldirty to hlknown were
+ * highlighted before the latest edits, so the entries between them are right
+ * as soon as the one a row before them ends in is.
+ *
+ * Rows past hlrows are lexed on a worker thread, from a snapshot of their
+ * text, and the states it finds are taken over by editorPollHighlight(). Rows
+ * that are drawn before it gets to them are highlighted right away when they
+ * are close to hlrows, and from the state they were last highlighted from
+ * otherwise, until the worker catches up.
+ */
+
+#define HL_SYNC_ROWS 4096
+#define HL_JOB_ROWS 65536
+
+struct hljob
+{
+	struct editorSyntax *syntax;
+	int from; // first row of the snapshot
+	int n;
+	char **lines;
+	int *lens;
+	char **copies; // text of rows that the UI thread may still edit
+	int ncopies;
+	unsigned char *states; // states[i] is the state row from + i starts in
+	int done; // rows lexed so far
+	int cancel;
+	int finished;
+};
 
-				if (!strncmp(&row->render[i], keywords[j], klen) &&
-					is_separator(row->render[i + klen]))
+struct hlworker
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int started;
+	struct hljob *next; // waiting for the worker to take it
+};
+
+static unsigned char *hlstates;
+static int hlcap = 0;
+static int hlrows = 0;
+static int hldirty = 0;
+static int hlknown = 0;
+
+static struct hlworker worker =
+{
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+static struct hljob *job = NULL;
+
+static void editorHighlightReserve(int at)
+{
+	if (at < hlcap)
+		return;
+	hlcap = (at + 1 > hlcap * 2) ? at + 1 : hlcap * 2;
+	hlstates = realloc(hlstates, hlcap);
+}
+
+/* Records the state row hlrows ends in. */
+static void editorHighlightAdvance(int state)
+{
+	int i = hlrows + 1;
+	if (i >= hldirty && i < hlknown && hlstates[i] == state)
+	{
+		hlrows = hlknown;
+		return;
+	}
+
+	editorHighlightReserve(i);
+	hlstates[i] = state;
+	hlrows = i;
+	if (hldirty <= i)
+		hldirty = i + 1;
+}
+
+static void *editorHighlightWorker(void *arg)
+{
+	while (1)
+	{
+		pthread_mutex_lock(&worker.lock);
+		while (worker.next == NULL)
+			pthread_cond_wait(&worker.cond, &worker.lock);
+		struct hljob *j = worker.next;
+		worker.next = NULL;
+		pthread_mutex_unlock(&worker.lock);
+
+		for (int i = 0; i < j->n; ++i)
+		{
+			if ((i & 255) == 0 && __atomic_load_n(&j->cancel, __ATOMIC_RELAXED))
+				break;
+			j->states[i + 1] = editorLex(j->syntax, j->lines[i], j->lens[i], NULL,
+				j->states[i]);
+			if ((i & 255) == 255 || i + 1 == j->n)
+				__atomic_store_n(&j->done, i + 1, __ATOMIC_RELEASE);
+		}
+
+		pthread_mutex_lock(&worker.lock);
+		__atomic_store_n(&j->finished, 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&worker.cond);
+		pthread_mutex_unlock(&worker.lock);
+	}
+	return NULL;
+}
+
+static void editorHighlightStart()
+{
+	struct hljob *j = calloc(1, sizeof(struct hljob));
+	j->syntax = E.syntax;
+	j->from = hlrows;
+	j->n = (E.numrows - hlrows < HL_JOB_ROWS) ? E.numrows - hlrows : HL_JOB_ROWS;
+	j->lines = malloc(sizeof(char *) * j->n);
+	j->lens = malloc(sizeof(int) * j->n);
+	j->states = malloc(j->n + 1);
+	j->states[0] = hlstates[hlrows];
+
+	// unedited text lives in buffers that are not freed while the file is open
+	int cap = 0;
+	ptiter it;
+	ptIterInit(&it, j->from);
+	for (int i = 0; i < j->n; ++i)
+	{
+		erow *row;
+		char *s;
+		int len;
+		ptIterNext(&it, &row, &s, &len);
+		if (row)
+		{
+			len = row->size;
+			s = editorRowCharsFrom(row, 0);
+			if (row->owned)
+			{
+				if (j->ncopies == cap)
 				{
-					memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-					i += klen;
-					break;
+					cap = cap ? cap * 2 : 16;
+					j->copies = realloc(j->copies, sizeof(char *) * cap);
 				}
-			}
-			if (keywords[j] != NULL)
-			{
-				prev_sep = 0;
-				continue;
+				s = j->copies[j->ncopies++] = memcpy(malloc(len + 1), s, len);
 			}
 		}
+		j->lines[i] = s;
+		j->lens[i] = len;
+	}
 
-		prev_sep = is_separator(c);
-		++i;
+	pthread_mutex_lock(&worker.lock);
+	if (!worker.started)
+	{
+		pthread_create(&worker.thread, NULL, editorHighlightWorker, NULL);
+		worker.started = 1;
 	}
+	worker.next = j;
+	pthread_cond_broadcast(&worker.cond);
+	pthread_mutex_unlock(&worker.lock);
+	job = j;
+}
 
-	int changed = (row->hl_open_comment != in_comment);
-	row->hl_open_comment = in_comment;
-	if (changed && row->idx + 1 < E.numrows)
-		editorUpdateSyntax(&E.row[row->idx + 1]);
+static void editorHighlightFree(struct hljob *j)
+{
+	for (int i = 0; i < j->ncopies; ++i)
+		free(j->copies[i]);
+	free(j->copies);
+	free(j->lines);
+	free(j->lens);
+	free(j->states);
+	free(j);
 }
 
-static editorColor *makeEditorColor(int R, int G, int B, int index)
+/* Takes over the states the worker has published so far. */
+static void editorHighlightAbsorb()
 {
-	editorColor *color = malloc(sizeof(editorColor));
-	color->R = R;
-	color->G = G;
-	color->B = B;
-	color->colorIndex = index;
-	return color;
+	if (job->cancel)
+		return;
+	int end = job->from + __atomic_load_n(&job->done, __ATOMIC_ACQUIRE);
+	while (hlrows < end)
+		editorHighlightAdvance(job->states[hlrows - job->from + 1]);
 }
 
-editorColor *editorSyntaxToColor(int hl)
+void editorPollHighlight()
 {
-	switch (hl)
+	if (job)
 	{
-	case HL_COMMENT:
-	case HL_MLCOMMENT:
-		return makeEditorColor(106, 153, 85, hl);
-	case HL_KEYWORD1:
-		return makeEditorColor(197, 134, 192, hl);
-	case HL_KEYWORD2:
-		return makeEditorColor(86, 156, 214, hl);
-	case HL_STRING:
-		return makeEditorColor(206, 145, 120, hl);
-	case HL_NUMBER:
-		return makeEditorColor(181, 206, 168, hl);
-	case HL_MATCH:
-		return makeEditorColor(255, 255, 0, hl);
-	default:
-		return makeEditorColor(255, 255, 255, hl);
+		editorHighlightAbsorb();
+		if (__atomic_load_n(&job->finished, __ATOMIC_ACQUIRE))
+		{
+			editorHighlightFree(job);
+			job = NULL;
+		}
 	}
+	if (job == NULL && E.syntax && hlrows < E.numrows)
+		editorHighlightStart();
+	E.highlighting = (job != NULL);
 }
 
-void editorSelectSyntaxHighlight()
+/* Lexes the rows from hlrows up to 'at' for the state they end in. */
+static void editorHighlightTo(int at)
 {
-	E.syntax = NULL;
-	if (E.filename == NULL) return;
+	if (hlrows >= at)
+		return;
 
-	char *ext = strrchr(E.filename, '.');
+	ptiter it;
+	ptIterInit(&it, hlrows);
+	while (hlrows < at)
+	{
+		erow *row;
+		char *s;
+		int len;
+		ptIterNext(&it, &row, &s, &len);
+		if (row)
+		{
+			len = row->size;
+			s = editorRowCharsFrom(row, 0);
+		}
+
+		int from = hlrows;
+		editorHighlightAdvance(editorLex(E.syntax, s, len, NULL,
+			hlstates[hlrows]));
+		if (hlrows != from + 1 && hlrows < at)
+			ptIterInit(&it, hlrows);
+	}
+}
+
+void editorHighlightEdited(int at)
+{
+	if (E.syntax == NULL)
+		return;
+	if (job && at < job->from + job->n)
+		__atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
 
-	for (unsigned int j = 0; j < HLDB_ENTRIES; j++)
+	if (at < hlrows)
 	{
-		struct editorSyntax *s = &HLDB[j];
-		unsigned int i = 0;
-		while (s->filematch[i])
+		if (hldirty >= hlknown)
 		{
-			int is_ext = (s->filematch[i][0] == '.');
-			if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
-				(!is_ext && strstr(E.filename, s->filematch[i])))
-			{
-				E.syntax = s;
+			hldirty = at + 1;
+			hlknown = hlrows;
+		}
+		hlrows = at;
+	}
+	else if (at >= hldirty && at < hlknown)
+	{
+		hldirty = at + 1;
+	}
+}
 
-				for (int filerow = 0; filerow < E.numrows; filerow++)
-					editorUpdateSyntax(&E.row[filerow]);
-			}
-			++i;
+/* Makes room for n rows inserted at 'at' (n > 0) or drops the -n deleted
+   there (n < 0). editorHighlightEdited() is called for 'at' after this,
+   and for the last inserted row too when there are several. */
+void editorHighlightShift(int at, int n)
+{
+	if (E.syntax == NULL)
+		return;
+
+	int end = ((hlrows > hlknown) ? hlrows : hlknown) + 1;
+	if (n > 0 && at < end)
+	{
+		editorHighlightReserve(end + n - 1);
+		memmove(&hlstates[at + n], &hlstates[at], end - at);
+	}
+	else if (n < 0 && at + 1 - n < end)
+	{
+		memmove(&hlstates[at + 1], &hlstates[at + 1 - n], end - at - 1 + n);
+	}
+
+	// marks inside the rows that went away end up at 'at'
+	int *marks[] = { &hlrows, &hldirty, &hlknown };
+	for (int i = 0; i < 3; ++i)
+	{
+		if (n > 0 ? *marks[i] >= at : *marks[i] > at)
+			*marks[i] = (*marks[i] + n > at) ? *marks[i] + n : at;
+	}
+}
+
+void editorUpdateSyntax(erow *row, int at)
+{
+	if (E.syntax == NULL)
+	{
+		if (row->hl_state != 0)
+		{
+			memset(row->hl, HL_NORMAL, row->rsize);
+			row->hl_state = 0;
 		}
+		return;
 	}
-}
\ No newline at end of file
+
+	if (job)
+		editorHighlightAbsorb();
+
+	int state;
+	if (at - hlrows > HL_SYNC_ROWS)
+	{
+		state = (row->hl_state > 0) ? row->hl_state : 0;
+	}
+	else
+	{
+		editorHighlightTo(at);
+		state = hlstates[at];
+	}
+
+	if (row->hl_state == state)
+		return;
+	int end = editorLex(E.syntax, row->render, row->rsize, row->hl, state);
+	row->hl_state = state;
+	if (at == hlrows)
+		editorHighlightAdvance(end);
+}
+
+void editorSelectSyntaxHighlight()
+{
+	E.syntax = E.filename ? editorFindSyntax(E.filename) : NULL;
+
+	// rows are highlighted again when they are next drawn
+	if (job)
+		__atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+	ptForEachRow(editorInvalidateRow);
+	editorHighlightReserve(0);
+	hlstates[0] = 0;
+	hlrows = 0;
+	hldirty = 0;
+	hlknown = 0;
+}
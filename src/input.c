@@ -3,20 +3,36 @@
 #include <ctype.h>
 
 #include "../include/editor.h"
+#include "../include/ptable.h"
+#include "../include/highlight.h"
 #include "../include/output.h"
 #include "../include/terminal.h"
 #include "../include/editorOp.h"
 #include "../include/find.h"
 #include "../include/fileio.h"
+#include "../include/undo.h"
 
 #define KILO_QUIT_TIMES 3
-#define CTRL_KEY(k) ((k) & 0x1f)
+#define KILO_WHEEL_ROWS 3
 
 extern struct editorConfig E;
 
 /*** input ***/
 
-char *editorPrompt(char *prompt, void (*callback)(char *, int))
+/* Modified keys that have no binding of their own act as the plain key, so
+   Shift-Down moves down like Down does. Modified characters have none and
+   are dropped. */
+static int editorBaseKey(int c)
+{
+	if (c == -1 || !(c & KEY_MODS))
+		return c;
+	c &= ~KEY_MODS;
+	return (c >= ARROW_LEFT) ? c : -1;
+}
+
+/* Returns the line typed, or NULL if the prompt was left with ESC. An empty
+   line is only taken when allow_empty is set. */
+char *editorPrompt(char *prompt, void (*callback)(char *, int), int allow_empty)
 {
 	size_t bufsize = 128;
 	char *buf = malloc(bufsize);
@@ -27,10 +43,34 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
 	while (1)
 	{
 		editorSetStatusMessage(prompt, buf);
+		editorPollHighlight();
+		editorPollFind();
+		editorPollSave();
 		editorRefreshScreen();
 
-		int c = editorReadKey();
-		if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE)
+		int c = editorBaseKey(editorReadKey());
+		if (c == -1 || c == MOUSE_EVENT)
+			continue; // only a redraw was asked for
+		if (c == PASTE_START)
+		{
+			// a prompt is one line, so only the first line of a paste is kept
+			int len;
+			char *text = editorReadPaste(&len);
+			for (int i = 0; i < len && text[i] != '\r' && text[i] != '\n'; ++i)
+			{
+				if (iscntrl((unsigned char)text[i]))
+					continue;
+				if (buflen == bufsize - 1)
+				{
+					bufsize *= 2;
+					buf = realloc(buf, bufsize);
+				}
+				buf[buflen++] = text[i];
+			}
+			buf[buflen] = '\0';
+			free(text);
+		}
+		else if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE)
 		{
 			if (buflen != 0)
 				buf[--buflen] = '\0';
@@ -44,14 +84,14 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
 		}
 		else if (c == '\r')
 		{
-			if (buflen != 0)
+			if (buflen != 0 || allow_empty)
 			{
 				editorSetStatusMessage("");
 				if (callback) callback(buf, c);
 				return buf;
 			}
 		}
-		else if (!iscntrl(c) && c < 128)
+		else if (c < 128 && !iscntrl(c))
 		{
 			if (buflen == bufsize - 1)
 			{
@@ -68,7 +108,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
 
 void editorMoveCursor(int key)
 {
-	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+	erow *row = (E.cy >= E.numrows) ? NULL : ptRow(E.cy);
 
 	switch (key)
 	{
@@ -78,7 +118,7 @@ void editorMoveCursor(int key)
 		else if (E.cy > 0)
 		{
 			--E.cy;
-			E.cx = E.row[E.cy].size;
+			E.cx = ptRow(E.cy)->size;
 		}
 		break;
 	case ARROW_RIGHT:
@@ -100,20 +140,42 @@ void editorMoveCursor(int key)
 		break;
 	}
 
-	row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+	row = (E.cy >= E.numrows) ? NULL : ptRow(E.cy);
 	int rowlen = row ? row->size : 0;
 	if (E.cx > rowlen)
 		E.cx = rowlen;
 }
 
+/* Moves the cursor to a clicked cell, or by a few rows for the wheel. */
+static void editorMouse()
+{
+	struct editorMouse *m = &E.mouse;
+
+	if (m->button == 64 || m->button == 65)
+	{
+		int times = KILO_WHEEL_ROWS;
+		while (times--)
+			editorMoveCursor(m->button == 64 ? ARROW_UP : ARROW_DOWN);
+	}
+	else if (m->button == 0 && m->pressed && m->y < E.screenrows)
+	{
+		E.cy = m->y + E.rowoff;
+		if (E.cy > E.numrows)
+			E.cy = E.numrows;
+		int rx = m->x - E.volnum + E.coloff;
+		E.cx = (E.cy < E.numrows && rx > 0) ? editorRowRxToCx(ptRow(E.cy), rx) : 0;
+	}
+}
+
 void editorProcessKeypress()
 {
 	static int quit_times = KILO_QUIT_TIMES;
 
-	int c = editorReadKey();
+	int c = editorBaseKey(editorReadKey());
 
 	if (c != -1)
 	{
+		editorUndoMark();
 		switch (c)
 		{
 		case '\r':
@@ -121,6 +183,7 @@ void editorProcessKeypress()
 			break;
 	
 		case CTRL_KEY('q'):
+			editorFinishSave();
 			if (E.dirty && quit_times > 0)
 			{
 				editorSetStatusMessage("WARNING!!! File has unsaved changes. "
@@ -136,6 +199,15 @@ void editorProcessKeypress()
 		case CTRL_KEY('s'):
 			editorSave();
 			break;
+
+		case PASTE_START:
+			{
+				int len;
+				char *text = editorReadPaste(&len);
+				editorInsertText(text, len);
+				free(text);
+			}
+			break;
 	
 		case HOME_KEY:
 			E.cx = 0;
@@ -143,13 +215,25 @@ void editorProcessKeypress()
 	
 		case END_KEY:
 			if (E.cy < E.numrows)
-				E.cx = E.row[E.cy].size;
+				E.cx = ptRow(E.cy)->size;
 			break;
 
 		case CTRL_KEY('f'):
 			editorFind();
 			break;
 
+		case CTRL_KEY('r'):
+			editorReplace();
+			break;
+
+		case CTRL_KEY('z'):
+			editorUndo();
+			break;
+
+		case CTRL_KEY('y'):
+			editorRedo();
+			break;
+
 		case BACKSPACE:
 		case CTRL_KEY('h'):
 		case DEL_KEY:
@@ -184,15 +268,26 @@ void editorProcessKeypress()
 			editorMoveCursor(c);
 			break;
 
+		case MOUSE_EVENT:
+			editorMouse();
+			break;
+
 		case CTRL_KEY('l'):
 		case '\x1b':
 			break;
 
 		default:
-			editorInsertChar(c);
+			if (c < ARROW_LEFT) // function keys do nothing yet
+				editorInsertChar(c);
 			break;
 		}
 	}
+	if (c == -1)
+		return; // only a redraw was asked for, which is not a key
+
+	// the line after the last one only exists once the whole file is known
+	if (E.loading && E.cy >= E.numrows)
+		editorFinishOpen();
 
 	quit_times = KILO_QUIT_TIMES;
 }
\ No newline at end of file
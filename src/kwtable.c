@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/kwtable.h"
+
+#define KW_MAX_SEEDS 100000
+#define KW_MAX_SLOTS (1 << 16)
+
+/*** keyword tables ***/
+
+/* Returns whether s is one of the n words. */
+int kwListed(const struct kwentry *words, int n, const char *s, int len)
+{
+	for (int i = 0; i < n; ++i)
+		if (words[i].len == len && memcmp(words[i].word, s, len) == 0)
+			return 1;
+	return 0;
+}
+
+/* Places every word under seed, returns -1 if two of them collide. */
+static int kwPlace(struct kwentry *slots, unsigned int size, unsigned int seed,
+	const struct kwentry *words, int n)
+{
+	memset(slots, 0, sizeof(struct kwentry) * size);
+
+	for (int i = 0; i < n; ++i)
+	{
+		unsigned int h = kwHash(seed, words[i].word, words[i].len) & (size - 1);
+		if (slots[h].word != NULL)
+			return -1;
+		slots[h] = words[i];
+	}
+	return 0;
+}
+
+/* Fills t with a collision free table of the n words, which must all be
+   different. The words themselves are not copied. Returns -1 if there is
+   none of up to KW_MAX_SLOTS slots. */
+int kwBuild(struct kwtable *t, const struct kwentry *words, int n)
+{
+	unsigned int size = 8;
+	while (size < 2 * (unsigned int)n)
+		size *= 2;
+
+	for (; size <= KW_MAX_SLOTS; size *= 2)
+	{
+		struct kwentry *slots = calloc(size, sizeof(struct kwentry));
+		for (unsigned int seed = 2166136261u; seed < 2166136261u + KW_MAX_SEEDS; ++seed)
+		{
+			if (kwPlace(slots, size, seed, words, n) == 0)
+			{
+				t->slots = slots;
+				t->mask = size - 1;
+				t->seed = seed;
+				t->maxlen = 0;
+				for (int i = 0; i < n; ++i)
+					if (words[i].len > t->maxlen)
+						t->maxlen = words[i].len;
+				return 0;
+			}
+		}
+		free(slots);
+	}
+	return -1;
+}
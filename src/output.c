@@ -6,9 +6,12 @@
 
 #include "../include/editor.h"
 #include "../include/highlight.h"
+#include "../include/ptable.h"
 #include "../include/abuf.h"
+#include "../include/screen.h"
 
 #define KILO_VERSION "0.0.1"
+#define KILO_MSG_SECS 5 // how long a status message stays up
 
 extern struct editorConfig E;
 
@@ -27,11 +30,14 @@ int editorVolumeNum(int i)
 	return volnum;
 }
 
+/* Brings rowoff, coloff and rx up to date with the cursor. */
 void editorScroll()
 {
+	E.volnum = editorVolumeNum(E.numrows);
+
 	E.rx = 0;
 	if (E.cy < E.numrows)
-		E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+		E.rx = editorRowCxToRx(ptRow(E.cy), E.cx);
 
 	if (E.cy < E.rowoff)
 		E.rowoff = E.cy;
@@ -46,7 +52,7 @@ void editorScroll()
 		E.coloff = E.rx - E.screencols + 1 + E.volnum;
 }
 
-void editorDrawRows(struct abuf *ab)
+void editorDrawRows()
 {
 	for (int y = 0; y < E.screenrows; ++y)
 	{
@@ -64,134 +70,159 @@ void editorDrawRows(struct abuf *ab)
 				int padding = (E.screencols - welcomelen) / 2;
 				if (padding)
 				{
-					abAppend(ab, "~", 1);
+					screenAppend(y, "~", 1, SCREEN_PLAIN);
 					padding--;
 				}
 				while (padding--)
-					abAppend(ab, " ", 1);
-				abAppend(ab, welcome, welcomelen);
+					screenAppend(y, " ", 1, SCREEN_PLAIN);
+				screenAppend(y, welcome, welcomelen, SCREEN_PLAIN);
 			}
 			else
 			{
-				abAppend(ab, "~", 1);
+				screenAppend(y, "~", 1, SCREEN_PLAIN);
 			}
 		}
 		else
 		{
-			int len = E.row[filerow].rsize - E.coloff;
+			erow *row = editorRow(filerow);
+			int len = row->rsize - E.coloff;
 			if (len < 0) len = 0;
 			if (len > E.screencols - E.volnum) len = E.screencols - E.volnum;
 
-			char *c = &E.row[filerow].render[E.coloff];
-			unsigned char *hl = &E.row[filerow].hl[E.coloff];
-			int current_color = -1;
+			char *c = &row->render[E.coloff];
+			unsigned char *hl = &row->hl[E.coloff];
 
-			int current_numvol = editorVolumeNum(E.row[filerow].idx + 1);
+			int current_numvol = editorVolumeNum(filerow + 1);
 			for (int i = E.volnum - current_numvol; i > 0; i--)
-				abAppend(ab, " ", 1);
+				screenAppend(y, " ", 1, SCREEN_PLAIN);
 			char buf2[16];
-			snprintf(buf2, sizeof(buf2), "%d", E.row[filerow].idx + 1);
-			abAppend(ab, buf2, current_numvol);
-			abAppend(ab, " ", 1);
+			int numlen = snprintf(buf2, sizeof(buf2), "%d", filerow + 1);
+			screenAppend(y, buf2, numlen, SCREEN_PLAIN);
+			screenAppend(y, " ", 1, SCREEN_PLAIN);
 
-			for (int j = 0; j < len; ++j)
+			int j = 0;
+			while (j < len)
 			{
 				if (iscntrl(c[j]))
 				{
 					char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-					abAppend(ab, "\x1b[7m", 4);
-					abAppend(ab, &sym, 1);
-					abAppend(ab, "\x1b[m", 3);
-					if (current_color != -1)
-					{
-						char buf[16];
-						int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-						abAppend(ab, buf, clen);
-					}
-				}
-				else
-				{
-					editorColor *color = editorSyntaxToColor(hl[j]);
-					if (color->colorIndex != current_color)
-					{
-						current_color = color->colorIndex;
-						char buf[32];
-						int clen = snprintf(buf, sizeof(buf), "\x1b[38;2;%d;%d;%dm",
-							color->R, color->G, color->B);
-						abAppend(ab, buf, clen);
-					}
-					abAppend(ab, &c[j], 1);
+					screenAppend(y, &sym, 1, SCREEN_PLAIN | SCREEN_INVERSE);
+					++j;
+					continue;
 				}
+				int run = j + 1;
+				while (run < len && !iscntrl(c[run]))
+					++run;
+				screenAppendHighlighted(y, &c[j], &hl[j], run - j);
+				j = run;
 			}
-			abAppend(ab, "\x1b[39m", 5);
 		}
-
-		abAppend(ab, "\x1b[K", 3); // erases part of the current line
-		abAppend(ab, "\r\n", 2);
 	}
 }
 
-void editorDrawStatusBar(struct abuf *ab)
+/* Appends to s, which holds len of its size bytes, and returns the new
+   length. What does not fit is cut off. */
+static int editorStatusAppend(char *s, int size, int len, const char *fmt, ...)
 {
-	abAppend(ab, "\x1b[7m", 4);
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(&s[len], size - len, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		len += n;
+	return (len < size - 1) ? len : size - 1;
+}
+
+void editorDrawStatusBar()
+{
+	int y = E.screenrows;
 	char status[80], rstatus[80];
-	int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-		E.filename ? E.filename : "[No Name]", E.numrows,
+	int len = snprintf(status, sizeof(status), "%.20s - %d%s lines %s",
+		E.filename ? E.filename : "[No Name]", E.numrows, E.loading ? "+" : "",
 		E.dirty ? "(modified)" : "");
-	int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
+	int rlen = 0;
+	if (E.matches >= 0 && E.regex)
+		rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "regex ");
+	if (E.matches == 0 && E.searching)
+		rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "searching | ");
+	else if (E.matches == 0)
+		rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "no matches | ");
+	else if (E.matches > 0)
+		rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "match %d of %d%s | ",
+			E.match, E.matches, E.searching ? "+" : "");
+	if (E.saving)
+		rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "saving %d%% | ", E.saved);
+	rlen = editorStatusAppend(rstatus, sizeof(rstatus), rlen, "%s | %d/%d",
 		E.syntax ? E.syntax->filetype : "no ft", E.cy + 1, E.numrows);
 	if (len > E.screencols) len = E.screencols;
-	abAppend(ab, status, len);
+	screenAppend(y, status, len, SCREEN_PLAIN | SCREEN_INVERSE);
 	while (len < E.screencols)
 	{
 		if (E.screencols - len == rlen)
 		{
-			abAppend(ab, rstatus, rlen);
+			screenAppend(y, rstatus, rlen, SCREEN_PLAIN | SCREEN_INVERSE);
 			break;
 		}
 		else
 		{
-			abAppend(ab, " ", 1);
+			screenAppend(y, " ", 1, SCREEN_PLAIN | SCREEN_INVERSE);
 			len++;
 		}
 	}
-	abAppend(ab, "\x1b[m", 3);
-	abAppend(ab, "\r\n", 2);
 }
 
-void editorDrawMessageBar(struct abuf *ab)
+void editorDrawMessageBar()
 {
-	abAppend(ab, "\x1b[K", 3);
 	int msglen = strlen(E.statusmsg);
 	if (msglen > E.screencols) msglen = E.screencols;
-	if (msglen && time(NULL) - E.statusmsg_time < 5)
-		abAppend(ab, E.statusmsg, msglen);
+	if (msglen && time(NULL) - E.statusmsg_time < KILO_MSG_SECS)
+		screenAppend(E.screenrows + 1, E.statusmsg, msglen, SCREEN_PLAIN);
+	else
+		E.statusmsg[0] = '\0'; // so editorStatusTimeout() stops waking us up
 }
 
 void editorRefreshScreen()
 {
-	E.volnum = editorVolumeNum(E.numrows);
-
+	static int prev_rowoff = 0;
 	editorScroll();
 
-	struct abuf ab = ABUF_INIT;
+	screenBegin(E.screenrows + 2, E.screencols);
+	if (E.rowoff != prev_rowoff)
+		screenScroll(0, E.screenrows, E.rowoff - prev_rowoff);
+	prev_rowoff = E.rowoff;
+	editorDrawRows();
+	editorDrawStatusBar();
+	editorDrawMessageBar();
 
-	abAppend(&ab, "\x1b[?25l", 6); // Hide the cursor
-	abAppend(&ab, "\x1b[H", 3); // Reposition the cursor
-
-	editorDrawRows(&ab);
-	editorDrawStatusBar(&ab);
-	editorDrawMessageBar(&ab);
+	static struct abuf ab = ABUF_INIT; // kept, so frames stop allocating
+	abReset(&ab);
+	screenFlush(&ab);
 
 	char buf[32];
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1,
-											  (E.rx - E.coloff) + E.volnum + 1);
-	abAppend(&ab, buf, strlen(buf));
+	int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH\x1b[?25h",
+		(E.cy - E.rowoff) + 1, (E.rx - E.coloff) + E.volnum + 1);
 
-	abAppend(&ab, "\x1b[?25h", 6);
+	struct iovec iov[] =
+	{
+		{ "\x1b[?25l", 6 }, // Hide the cursor while the frame is written
+		{ ab.b, ab.len },
+		{ buf, len }
+	};
+	abWritev(STDOUT_FILENO, iov, 3);
+}
 
-	write(STDOUT_FILENO, ab.b, ab.len);
-	abFree(&ab);
+/* Returns the milliseconds until the status message is to be taken down,
+   or -1 when none is up. */
+int editorStatusTimeout()
+{
+	if (E.statusmsg[0] == '\0')
+		return -1;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	long left = (E.statusmsg_time + KILO_MSG_SECS) * 1000L -
+		(ts.tv_sec * 1000L + ts.tv_nsec / 1000000);
+	return left > 0 ? left : 0;
 }
 
 void editorSetStatusMessage(const char *fmt, ...)
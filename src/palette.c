@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/highlight.h"
+#include "../include/palette.h"
+
+/*
+ * The colors of the highlight classes come from a theme, which is the one
+ * below unless $KILO_THEME or ~/.kilo/theme names others:
+ *
+ *   comment 106 153 85
+ *   string #ce9178
+ *   colors 256            24 (true color), 256 or 16
+ *
+ * Terminals that do not say they have true color get the nearest of the 256
+ * or 16 colors they do have. The escapes are built once, so drawing a row
+ * only copies them.
+ */
+
+struct rgb
+{
+	int R;
+	int G;
+	int B;
+};
+
+static struct rgb theme[HL_NCLASSES] =
+{
+	[HL_NORMAL] = { 255, 255, 255 },
+	[HL_COMMENT] = { 106, 153, 85 },
+	[HL_MLCOMMENT] = { 106, 153, 85 },
+	[HL_KEYWORD1] = { 197, 134, 192 },
+	[HL_KEYWORD2] = { 86, 156, 214 },
+	[HL_STRING] = { 206, 145, 120 },
+	[HL_NUMBER] = { 181, 206, 168 },
+	[HL_MATCH] = { 255, 255, 0 }
+};
+
+static const char *theme_names[HL_NCLASSES] =
+{
+	"normal", "comment", "mlcomment", "keyword1", "keyword2", "string",
+	"number", "match"
+};
+
+/* The colors xterm gives the 16 ANSI ones by default. */
+static const struct rgb ansi[16] =
+{
+	{ 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+	{ 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+	{ 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+	{ 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 }
+};
+
+struct sgr palette[HL_NCLASSES];
+
+/*** color matching ***/
+
+static int colorDistance(struct rgb a, struct rgb b)
+{
+	return (a.R - b.R) * (a.R - b.R) + (a.G - b.G) * (a.G - b.G) +
+		(a.B - b.B) * (a.B - b.B);
+}
+
+static int cubeLevel(int v)
+{
+	return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+}
+
+static int cubeValue(int level)
+{
+	return level ? 55 + level * 40 : 0;
+}
+
+/* Returns the nearest color of the 6x6x6 cube and grey ramp of 256 color
+   terminals. */
+static int nearest256(struct rgb c)
+{
+	struct rgb cube = { cubeValue(cubeLevel(c.R)), cubeValue(cubeLevel(c.G)),
+		cubeValue(cubeLevel(c.B)) };
+	int index = 16 + 36 * cubeLevel(c.R) + 6 * cubeLevel(c.G) + cubeLevel(c.B);
+
+	int grey = ((c.R + c.G + c.B) / 3 - 8) / 10;
+	if (grey < 0) grey = 0;
+	if (grey > 23) grey = 23;
+	struct rgb g = { 8 + grey * 10, 8 + grey * 10, 8 + grey * 10 };
+
+	return colorDistance(c, g) < colorDistance(c, cube) ? 232 + grey : index;
+}
+
+static int nearest16(struct rgb c)
+{
+	int best = 0;
+	for (int i = 1; i < 16; ++i)
+		if (colorDistance(c, ansi[i]) < colorDistance(c, ansi[best]))
+			best = i;
+	return best;
+}
+
+/*** palette ***/
+
+static int clampColor(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static void editorReadTheme(const char *path, int *depth)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return;
+
+	char line[128];
+	while (fgets(line, sizeof(line), fp))
+	{
+		char name[32];
+		struct rgb c;
+		unsigned int hex;
+		int n;
+
+		if (sscanf(line, "colors %d", &n) == 1)
+		{
+			*depth = (n == 24 || n == 256 || n == 16) ? n : *depth;
+			continue;
+		}
+		if (sscanf(line, "%31s %d %d %d", name, &c.R, &c.G, &c.B) != 4)
+		{
+			if (sscanf(line, "%31s #%6x", name, &hex) != 2)
+				continue;
+			c.R = hex >> 16;
+			c.G = (hex >> 8) & 0xff;
+			c.B = hex & 0xff;
+		}
+		for (int i = 0; i < HL_NCLASSES; ++i)
+		{
+			if (!strcmp(name, theme_names[i]))
+			{
+				theme[i].R = clampColor(c.R);
+				theme[i].G = clampColor(c.G);
+				theme[i].B = clampColor(c.B);
+			}
+		}
+	}
+	fclose(fp);
+}
+
+static int editorColorDepth()
+{
+	char *colorterm = getenv("COLORTERM");
+	if (colorterm && (!strcmp(colorterm, "truecolor") || !strcmp(colorterm, "24bit")))
+		return 24;
+	char *term = getenv("TERM");
+	if (term && strstr(term, "256color"))
+		return 256;
+	return 16;
+}
+
+void editorLoadPalette()
+{
+	int depth = editorColorDepth();
+
+	char *path = getenv("KILO_THEME");
+	char *home = getenv("HOME");
+	if (path)
+	{
+		editorReadTheme(path, &depth);
+	}
+	else if (home)
+	{
+		char *p = malloc(strlen(home) + sizeof("/.kilo/theme"));
+		sprintf(p, "%s/.kilo/theme", home);
+		editorReadTheme(p, &depth);
+		free(p);
+	}
+
+	for (int i = 0; i < HL_NCLASSES; ++i)
+	{
+		struct rgb c = theme[i];
+		struct sgr *s = &palette[i];
+		if (depth == 24)
+		{
+			s->len = snprintf(s->seq, sizeof(s->seq), "\x1b[38;2;%d;%d;%dm",
+				c.R, c.G, c.B);
+		}
+		else if (depth == 256)
+		{
+			s->len = snprintf(s->seq, sizeof(s->seq), "\x1b[38;5;%dm", nearest256(c));
+		}
+		else
+		{
+			int n = nearest16(c);
+			s->len = snprintf(s->seq, sizeof(s->seq), "\x1b[%dm",
+				n < 8 ? 30 + n : 90 + n - 8);
+		}
+	}
+}
@@ -0,0 +1,724 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/ptable.h"
+#include "../include/scan.h"
+
+#define PT_ADD_CHUNK (64 * 1024)
+#define PT_BLOCK (16 * 1024)
+#define PT_EAGER (1024 * 1024) // indexed before ptOpen returns
+#define PT_CHUNK 4096 // blocks an indexer thread counts at a time
+#define PT_MAX_THREADS 16
+
+/*
+ * The document is kept as a piece table. The file being edited is mapped
+ * read-only (the original buffer), the text of every inserted row is copied
+ * into an append-only add buffer, and the order of the lines is described by
+ * a treap of pieces keyed by their position in the document. A piece covers a
+ * run of consecutive lines of the original buffer; once a row is needed as an
+ * erow it is split off into a piece of its own which keeps the materialized
+ * row, so inserting or deleting a line only costs O(log n).
+ *
+ * The original buffer is indexed sparsely: only the number of newlines in
+ * front of every PT_BLOCK bytes is kept, and a line is found by a binary
+ * search over the blocks followed by a scan of one block. The first
+ * PT_EAGER bytes are indexed by ptOpen. The rest is split into chunks of
+ * PT_CHUNK blocks that a pool of threads counts in parallel, while a merging
+ * thread turns the per-block counts into running totals in chunk order and
+ * publishes them for ptPoll to pick up.
+ */
+
+struct ptbuf
+{
+	char *data;
+	size_t len;
+	int *nl; // newlines in front of every block
+	size_t nblocks;
+	size_t indexed; // blocks counted so far, written by the indexer
+	int numlines; // lines handed out to the piece tree
+	int mapped;
+};
+
+struct addchunk
+{
+	struct addchunk *next;
+	size_t len;
+	size_t cap;
+	char data[];
+};
+
+typedef struct piece
+{
+	struct piece *left;
+	struct piece *right;
+	struct piece *parent;
+	int prio;
+	int lines; // lines in this subtree
+	int count; // lines covered by this piece
+	int first; // first line of the piece in the original buffer
+	erow *row;
+} piece;
+
+static struct ptbuf orig;
+static struct addchunk *add = NULL;
+static piece *root = NULL;
+
+struct ptindexer
+{
+	struct ptbuf *buf;
+	size_t base; // first block to count
+	size_t nchunks;
+	size_t next; // next chunk to hand out
+	unsigned char *done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t workers[PT_MAX_THREADS];
+	int nworkers;
+};
+
+static struct ptindexer idx;
+static pthread_t indexer;
+static int indexing = 0;
+
+/*** buffers ***/
+
+static void ptInitIndex(struct ptbuf *b)
+{
+	b->nblocks = (b->len + PT_BLOCK - 1) / PT_BLOCK;
+	b->nl = malloc(sizeof(int) * (b->nblocks + 1));
+	b->nl[0] = 0;
+	b->indexed = 0;
+	b->numlines = 0;
+}
+
+static void ptIndexBlocks(struct ptbuf *b, size_t from, size_t to)
+{
+	for (size_t i = from; i < to; ++i)
+	{
+		size_t start = i * PT_BLOCK;
+		size_t len = (b->len - start < PT_BLOCK) ? b->len - start : PT_BLOCK;
+
+		b->nl[i + 1] = b->nl[i] + scanCountLines(&b->data[start], len);
+		__atomic_store_n(&b->indexed, i + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/* Workers leave the newline count of block i in nl[i + 1]; the merger
+   turns it into a running total once the chunks before it are merged. */
+static void *ptIndexWorker(void *arg)
+{
+	struct ptindexer *ix = arg;
+	struct ptbuf *b = ix->buf;
+	size_t c;
+
+	while ((c = __atomic_fetch_add(&ix->next, 1, __ATOMIC_RELAXED)) < ix->nchunks)
+	{
+		size_t from = ix->base + c * PT_CHUNK;
+		size_t to = (b->nblocks - from < PT_CHUNK) ? b->nblocks : from + PT_CHUNK;
+
+		for (size_t i = from; i < to; ++i)
+		{
+			size_t start = i * PT_BLOCK;
+			size_t len = (b->len - start < PT_BLOCK) ? b->len - start : PT_BLOCK;
+			b->nl[i + 1] = scanCountLines(&b->data[start], len);
+		}
+
+		pthread_mutex_lock(&ix->lock);
+		ix->done[c] = 1;
+		pthread_cond_signal(&ix->cond);
+		pthread_mutex_unlock(&ix->lock);
+	}
+	return NULL;
+}
+
+static void *ptIndexer(void *arg)
+{
+	struct ptindexer *ix = arg;
+	struct ptbuf *b = ix->buf;
+
+	for (size_t c = 0; c < ix->nchunks; ++c)
+	{
+		pthread_mutex_lock(&ix->lock);
+		while (!ix->done[c])
+			pthread_cond_wait(&ix->cond, &ix->lock);
+		pthread_mutex_unlock(&ix->lock);
+
+		size_t from = ix->base + c * PT_CHUNK;
+		size_t to = (b->nblocks - from < PT_CHUNK) ? b->nblocks : from + PT_CHUNK;
+		for (size_t i = from; i < to; ++i)
+			b->nl[i + 1] += b->nl[i];
+		__atomic_store_n(&b->indexed, to, __ATOMIC_RELEASE);
+	}
+
+	for (int i = 0; i < ix->nworkers; ++i)
+		pthread_join(ix->workers[i], NULL);
+	free(ix->done);
+	pthread_mutex_destroy(&ix->lock);
+	pthread_cond_destroy(&ix->cond);
+	return NULL;
+}
+
+static int ptStartIndexer(struct ptbuf *b)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	idx.buf = b;
+	idx.base = b->indexed;
+	idx.nchunks = (b->nblocks - idx.base + PT_CHUNK - 1) / PT_CHUNK;
+	idx.next = 0;
+	idx.done = calloc(idx.nchunks, 1);
+	pthread_mutex_init(&idx.lock, NULL);
+	pthread_cond_init(&idx.cond, NULL);
+
+	if (ncpu < 1)
+		ncpu = 1;
+	if (ncpu > PT_MAX_THREADS)
+		ncpu = PT_MAX_THREADS;
+	if ((size_t)ncpu > idx.nchunks)
+		ncpu = idx.nchunks;
+
+	idx.nworkers = 0;
+	while (idx.nworkers < ncpu &&
+		pthread_create(&idx.workers[idx.nworkers], NULL, ptIndexWorker, &idx) == 0)
+		++idx.nworkers;
+
+	if (idx.nworkers == 0 || pthread_create(&indexer, NULL, ptIndexer, &idx) != 0)
+	{
+		// count whatever is left on this thread and merge it here
+		ptIndexWorker(&idx);
+		ptIndexer(&idx);
+		return 0;
+	}
+	return 1;
+}
+
+/* Lines whose end has been seen by the indexer. */
+static int ptIndexedLines(struct ptbuf *b)
+{
+	if (b->nl == NULL)
+		return 0;
+
+	size_t done = __atomic_load_n(&b->indexed, __ATOMIC_ACQUIRE);
+	int lines = b->nl[done];
+	if (done == b->nblocks && b->len > 0 && b->data[b->len - 1] != '\n')
+		++lines;
+	return lines;
+}
+
+static size_t ptLineStart(struct ptbuf *b, int line)
+{
+	if (line == 0)
+		return 0;
+
+	size_t lo = 0;
+	size_t hi = __atomic_load_n(&b->indexed, __ATOMIC_ACQUIRE);
+	while (hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (b->nl[mid] < line)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	const char *p = &b->data[lo * PT_BLOCK];
+	const char *end = &b->data[b->len];
+	p = scanSkipLines(p, end - p, line - b->nl[lo]);
+	return p - b->data;
+}
+
+/* Returns the line starting at *off and moves *off to the next one. */
+static char *ptNextLine(struct ptbuf *b, size_t *off, int *len)
+{
+	char *start = &b->data[*off];
+	char *nl = memchr(start, '\n', b->len - *off);
+	char *end = nl ? nl : &b->data[b->len];
+
+	*off = end - b->data + 1;
+	while (end > start && end[-1] == '\r')
+		--end;
+	*len = end - start;
+	return start;
+}
+
+static char *ptReadAll(int fd, size_t *len)
+{
+	size_t cap = 64 * 1024;
+	char *data = malloc(cap);
+	ssize_t nread;
+
+	*len = 0;
+	while ((nread = read(fd, &data[*len], cap - *len)) > 0)
+	{
+		*len += nread;
+		if (*len == cap)
+		{
+			cap *= 2;
+			data = realloc(data, cap);
+		}
+	}
+	if (nread == -1)
+	{
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static char *ptAppend(const char *s, size_t len)
+{
+	if (add == NULL || add->cap - add->len < len)
+	{
+		size_t cap = len > PT_ADD_CHUNK ? len : PT_ADD_CHUNK;
+		struct addchunk *chunk = malloc(sizeof(struct addchunk) + cap);
+
+		chunk->next = add;
+		chunk->len = 0;
+		chunk->cap = cap;
+		add = chunk;
+	}
+
+	char *p = &add->data[add->len];
+	memcpy(p, s, len);
+	add->len += len;
+	return p;
+}
+
+/*** piece tree ***/
+
+static int ptLines(piece *p)
+{
+	return p ? p->lines : 0;
+}
+
+static void ptPull(piece *p)
+{
+	p->lines = p->count + ptLines(p->left) + ptLines(p->right);
+	if (p->left)
+		p->left->parent = p;
+	if (p->right)
+		p->right->parent = p;
+}
+
+static piece *ptNewPiece(int first, int count)
+{
+	piece *p = malloc(sizeof(piece));
+
+	p->left = NULL;
+	p->right = NULL;
+	p->parent = NULL;
+	p->prio = rand();
+	p->lines = count;
+	p->count = count;
+	p->first = first;
+	p->row = NULL;
+	return p;
+}
+
+static void ptFreePiece(piece *p)
+{
+	if (p->row)
+	{
+		if (p->row->owned)
+			free(p->row->chars);
+		free(p->row->render);
+		free(p->row->hl);
+		free(p->row);
+	}
+	free(p);
+}
+
+static piece *ptMerge(piece *l, piece *r)
+{
+	if (l == NULL)
+		return r;
+	if (r == NULL)
+		return l;
+
+	if (l->prio > r->prio)
+	{
+		l->right = ptMerge(l->right, r);
+		ptPull(l);
+		return l;
+	}
+	else
+	{
+		r->left = ptMerge(l, r->left);
+		ptPull(r);
+		return r;
+	}
+}
+
+/* Splits t so that the first k lines end up in *l and the rest in *r,
+   cutting a piece in two when k falls inside it. */
+static void ptSplit(piece *t, int k, piece **l, piece **r)
+{
+	if (t == NULL)
+	{
+		*l = *r = NULL;
+		return;
+	}
+
+	int left = ptLines(t->left);
+	if (k <= left)
+	{
+		ptSplit(t->left, k, l, &t->left);
+		ptPull(t);
+		*r = t;
+	}
+	else if (k >= left + t->count)
+	{
+		ptSplit(t->right, k - left - t->count, &t->right, r);
+		ptPull(t);
+		*l = t;
+	}
+	else
+	{
+		int cut = k - left;
+		piece *rest = ptNewPiece(t->first + cut, t->count - cut);
+		piece *right = t->right;
+
+		t->count = cut;
+		t->right = NULL;
+		ptPull(t);
+		*l = t;
+		*r = ptMerge(rest, right);
+	}
+	if (*l)
+		(*l)->parent = NULL;
+	if (*r)
+		(*r)->parent = NULL;
+}
+
+static void ptSetRoot(piece *p)
+{
+	root = p;
+	if (root)
+		root->parent = NULL;
+}
+
+/* Returns the piece holding line at and sets *line to its offset there. */
+static piece *ptFind(int at, int *line)
+{
+	piece *p = root;
+
+	while (p)
+	{
+		int left = ptLines(p->left);
+		if (at < left)
+		{
+			p = p->left;
+		}
+		else if (at < left + p->count)
+		{
+			*line = at - left;
+			return p;
+		}
+		else
+		{
+			at -= left + p->count;
+			p = p->right;
+		}
+	}
+	return NULL;
+}
+
+static piece *ptSuccessor(piece *p)
+{
+	if (p->right)
+	{
+		p = p->right;
+		while (p->left)
+			p = p->left;
+		return p;
+	}
+	while (p->parent && p == p->parent->right)
+		p = p->parent;
+	return p->parent;
+}
+
+/*** piece table ***/
+
+int ptOpen(const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	orig.data = NULL;
+	orig.len = 0;
+	orig.mapped = 0;
+	if (S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		orig.data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (orig.data != MAP_FAILED)
+		{
+			orig.len = st.st_size;
+			orig.mapped = 1;
+		}
+		else
+		{
+			orig.data = NULL;
+		}
+	}
+	if (!orig.mapped)
+		orig.data = ptReadAll(fd, &orig.len);
+	close(fd);
+	if (orig.data == NULL && !orig.mapped)
+		return -1;
+
+	ptInitIndex(&orig);
+	size_t eager = PT_EAGER / PT_BLOCK;
+	if (eager > orig.nblocks)
+		eager = orig.nblocks;
+	ptIndexBlocks(&orig, 0, eager);
+	if (eager < orig.nblocks)
+		indexing = ptStartIndexer(&orig);
+	return 0;
+}
+
+/* Appends the lines indexed since the last call to the end of the document
+   and returns how many there were. */
+int ptPoll()
+{
+	int lines = ptIndexedLines(&orig);
+	int added = lines - orig.numlines;
+
+	if (added > 0)
+	{
+		ptSetRoot(ptMerge(root, ptNewPiece(orig.numlines, added)));
+		orig.numlines = lines;
+	}
+	if (indexing && __atomic_load_n(&orig.indexed, __ATOMIC_ACQUIRE) == orig.nblocks)
+	{
+		pthread_join(indexer, NULL);
+		indexing = 0;
+		added += ptPoll();
+	}
+	return added;
+}
+
+int ptLoading()
+{
+	return indexing;
+}
+
+/* Waits for the indexer and returns the lines it added, like ptPoll. */
+int ptFinishLoad()
+{
+	if (indexing)
+	{
+		pthread_join(indexer, NULL);
+		indexing = 0;
+	}
+	return ptPoll();
+}
+
+erow *ptRow(int at)
+{
+	if (at < 0 || at >= ptLines(root))
+		return NULL;
+
+	int line;
+	piece *p = ptFind(at, &line);
+	if (p->row == NULL)
+	{
+		if (p->count > 1)
+		{
+			piece *l, *r;
+			ptSplit(root, at, &l, &r);
+			ptSplit(r, 1, &p, &r);
+			ptSetRoot(ptMerge(ptMerge(l, p), r));
+		}
+
+		size_t off = ptLineStart(&orig, p->first);
+		p->row = calloc(1, sizeof(erow));
+		p->row->piece = p;
+		p->row->chars = ptNextLine(&orig, &off, &p->row->size);
+		p->row->gap = p->row->size;
+	}
+	return p->row;
+}
+
+/* Rows do not store their line number; it is the number of lines in front
+   of the row's piece, summed on the way up to the root. */
+int ptRowIndex(erow *row)
+{
+	piece *p = row->piece;
+	int at = ptLines(p->left);
+
+	while (p->parent)
+	{
+		if (p == p->parent->right)
+			at += ptLines(p->parent->left) + p->parent->count;
+		p = p->parent;
+	}
+	return at;
+}
+
+erow *ptInsertRow(int at, const char *s, size_t len)
+{
+	piece *p = ptNewPiece(-1, 1);
+	piece *l, *r;
+
+	p->row = calloc(1, sizeof(erow));
+	p->row->piece = p;
+	p->row->size = len;
+	p->row->chars = ptAppend(s, len);
+	p->row->gap = len;
+
+	ptSplit(root, at, &l, &r);
+	ptSetRoot(ptMerge(ptMerge(l, p), r));
+	return p->row;
+}
+
+/* Inserts the lines of s, which are separated by newlines, as rows from
+   'at' on. The pieces are merged into a tree of their own first, so the
+   document is only split and joined once. Returns the number of rows. */
+int ptInsertRows(int at, const char *s, size_t len)
+{
+	char *text = ptAppend(s, len);
+	char *end = text + len;
+	piece *rows = NULL;
+	int n = 0;
+
+	while (1)
+	{
+		char *nl = memchr(text, '\n', end - text);
+		char *eol = nl ? nl : end;
+		piece *p = ptNewPiece(-1, 1);
+
+		p->row = calloc(1, sizeof(erow));
+		p->row->piece = p;
+		p->row->size = eol - text;
+		p->row->chars = text;
+		p->row->gap = p->row->size;
+		rows = ptMerge(rows, p);
+		++n;
+
+		if (nl == NULL)
+			break;
+		text = nl + 1;
+	}
+
+	piece *l, *r;
+	ptSplit(root, at, &l, &r);
+	ptSetRoot(ptMerge(ptMerge(l, rows), r));
+	return n;
+}
+
+static void ptFreeTree(piece *p)
+{
+	if (p == NULL)
+		return;
+	ptFreeTree(p->left);
+	ptFreeTree(p->right);
+	ptFreePiece(p);
+}
+
+void ptDelRow(int at)
+{
+	ptDelRows(at, 1);
+}
+
+/* Removes n rows from 'at' on, cutting them out of the tree in one piece. */
+void ptDelRows(int at, int n)
+{
+	piece *l, *m, *r;
+
+	ptSplit(root, at, &l, &r);
+	ptSplit(r, n, &m, &r);
+	ptFreeTree(m);
+	ptSetRoot(ptMerge(l, r));
+}
+
+static void ptForEachPiece(piece *p, void (*fn)(erow *row))
+{
+	if (p == NULL)
+		return;
+
+	ptForEachPiece(p->left, fn);
+	if (p->row)
+		fn(p->row);
+	ptForEachPiece(p->right, fn);
+}
+
+/* Calls fn on every materialized row, in order. */
+void ptForEachRow(void (*fn)(erow *row))
+{
+	ptForEachPiece(root, fn);
+}
+
+/*** iteration ***/
+
+void ptIterInit(ptiter *it, int at)
+{
+	it->piece = (at < ptLines(root)) ? ptFind(at, &it->line) : NULL;
+	if (it->piece && it->piece->row == NULL)
+		it->off = ptLineStart(&orig, it->piece->first + it->line);
+}
+
+/* Steps to the next line. A materialized row is returned in *row, any
+   other line as its text in *s and *len. Returns 0 past the last line. */
+int ptIterNext(ptiter *it, erow **row, char **s, int *len)
+{
+	piece *p = it->piece;
+	if (p == NULL)
+		return 0;
+
+	*row = p->row;
+	if (p->row == NULL)
+		*s = ptNextLine(&orig, &it->off, len);
+
+	if (++it->line == p->count)
+	{
+		it->piece = ptSuccessor(p);
+		it->line = 0;
+		if (it->piece && it->piece->row == NULL)
+			it->off = ptLineStart(&orig, it->piece->first);
+	}
+	return 1;
+}
+
+/* Like ptIterNext, but a run of lines that are not materialized comes back
+   as a single stretch of the original buffer, up to the end of their piece:
+   *n lines separated by newlines (a line may end in \r), without the
+   newline after the last one. A materialized row comes back in *row with
+   *n = 1. Returns 0 past the last line. */
+int ptIterSpan(ptiter *it, erow **row, char **s, size_t *len, int *n)
+{
+	piece *p = it->piece;
+	if (p == NULL)
+		return 0;
+
+	*row = p->row;
+	*n = p->count - it->line;
+	if (p->row == NULL)
+	{
+		size_t off = ptLineStart(&orig, p->first + p->count - 1);
+		int lastlen;
+		char *last = ptNextLine(&orig, &off, &lastlen);
+		*s = &orig.data[it->off];
+		*len = last + lastlen - *s;
+	}
+
+	it->piece = ptSuccessor(p);
+	it->line = 0;
+	if (it->piece && it->piece->row == NULL)
+		it->off = ptLineStart(&orig, it->piece->first);
+	return 1;
+}
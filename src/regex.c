@@ -0,0 +1,1011 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../include/regex.h"
+#include "../include/scan.h"
+
+#define KILO_RE_MAXPROG 10000 // instructions a pattern may compile to
+#define KILO_RE_MAXREP 1000 // largest count in x{n,m}
+#define KILO_RE_MAXDEPTH 100 // nested groups
+#define KILO_RE_STATES 2048 // automaton states cached before starting over
+
+/*
+ * Patterns are compiled to a Thompson NFA and never backtracked, so a
+ * search takes time linear in the text whatever the pattern. Two machines
+ * run the program:
+ *
+ * reFindLine() finds the lines holding a match with a DFA that is built
+ * lazily from the NFA: each state is a set of NFA instructions, and its
+ * transition on a byte is worked out the first time it is taken and cached.
+ * Most bytes cost one table lookup. When the cache is full it is emptied
+ * and built again from where the search is. If every match contains some
+ * literal text, only the lines where scanFind() finds it are run through
+ * the DFA.
+ *
+ * reMatch() then runs the NFA as a Pike VM over such a line, which follows
+ * all threads in step and knows where each began, to find the leftmost
+ * match and its length. Alternatives are preferred left to right and
+ * repetitions are greedy unless followed by '?', as in Perl. reMatchAll()
+ * finds all the matches of a line that do not overlap in one run of the
+ * VM, which goes on looking for the next match while the threads that may
+ * still change the last one run, rather than starting over after it.
+ *
+ * Matches never span lines: '.' and classes do not match a newline, '^'
+ * and '$' match at the start and end of a line.
+ *
+ *   .  [abc] [^a-z]  \d \w \s \D \W \S  \t \r  \. \* ...
+ *   ^ $  (x) (?:x)  x|y  x* x+ x? x{n} x{n,} x{n,m}  x*? x+? x?? ...
+ */
+
+enum reOp
+{
+	RE_BYTE, // consumes a byte of 'set'
+	RE_SPLIT, // goes on at x and at y, x first
+	RE_JMP, // goes on at x
+	RE_BOL,
+	RE_EOL,
+	RE_MATCH
+};
+
+struct reinst
+{
+	int op;
+	int x, y;
+	int set;
+};
+
+struct reset
+{
+	unsigned char bits[32];
+};
+
+enum reNodeType
+{
+	N_EMPTY,
+	N_SET,
+	N_BOL,
+	N_EOL,
+	N_CAT,
+	N_ALT,
+	N_REP
+};
+
+struct renode
+{
+	int type;
+	int l, r; // operands, nodes[l] alone for N_REP
+	int set;
+	int min, max; // max is -1 when there is none
+	int greedy;
+};
+
+struct restate
+{
+	int next[256]; // state after a byte, -1 when not known yet, -2 when special
+	int off, n; // of the instructions in the pool
+	char bol, match, eolmatch;
+};
+
+struct rethread
+{
+	int pc;
+	int start;
+};
+
+/* Matches of reMatchAll() that begin at lo or after, and the best one found
+   so far, if end is not -1. */
+struct regroup
+{
+	int lo;
+	int start, end;
+};
+
+struct regex
+{
+	struct reinst *prog;
+	int nprog;
+	struct reset *sets;
+	int nsets;
+	char *must; // text that every match contains
+	int mustlen;
+
+	// lazy DFA
+	struct restate *states;
+	int nstates, capstates;
+	int *pool; // instructions of every state
+	int npool, cappool;
+	int table[KILO_RE_STATES * 2]; // hash of instruction sets to state + 1
+	int start; // state at the start of a line, -1 when not built
+	unsigned int flushes;
+
+	// scratch, sized by the program
+	unsigned int *mark;
+	unsigned int gen;
+	int *stack;
+	int *seeds;
+	int *follow;
+	struct rethread *clist, *nlist;
+	struct regroup *groups;
+	int capgroups;
+};
+
+/*** sets ***/
+
+static inline int reInSet(const struct reset *s, unsigned char c)
+{
+	return s->bits[c >> 3] & (1 << (c & 7));
+}
+
+static inline void reAddByte(struct reset *s, unsigned char c)
+{
+	s->bits[c >> 3] |= 1 << (c & 7);
+}
+
+static void reAddClass(struct reset *s, char cls)
+{
+	int neg = isupper((unsigned char)cls);
+	for (int c = 0; c < 256; ++c)
+	{
+		int in;
+		switch (tolower((unsigned char)cls))
+		{
+		case 'd': in = isdigit(c); break;
+		case 'w': in = isalnum(c) || c == '_'; break;
+		default: in = isspace(c); break;
+		}
+		if (!in != !neg)
+			reAddByte(s, c);
+	}
+}
+
+/*** parsing ***/
+
+struct reparser
+{
+	const char *p;
+	regex *re;
+	struct renode *nodes;
+	int nnodes, cap;
+	int err;
+};
+
+static int reNode(struct reparser *ps, int type, int l, int r)
+{
+	if (ps->nnodes == ps->cap)
+	{
+		ps->cap = ps->cap ? ps->cap * 2 : 64;
+		ps->nodes = realloc(ps->nodes, sizeof(struct renode) * ps->cap);
+	}
+	struct renode *n = &ps->nodes[ps->nnodes];
+	memset(n, 0, sizeof(struct renode));
+	n->type = type;
+	n->l = l;
+	n->r = r;
+	return ps->nnodes++;
+}
+
+static int reNewSet(struct reparser *ps)
+{
+	regex *re = ps->re;
+	re->sets = realloc(re->sets, sizeof(struct reset) * (re->nsets + 1));
+	memset(&re->sets[re->nsets], 0, sizeof(struct reset));
+	int n = reNode(ps, N_SET, -1, -1);
+	ps->nodes[n].set = re->nsets++;
+	return n;
+}
+
+/* Reads the character after a backslash into set s. */
+static void reEscape(struct reparser *ps, struct reset *s)
+{
+	char c = *ps->p++;
+	switch (c)
+	{
+	case '\0':
+		ps->err = 1;
+		--ps->p;
+		break;
+	case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+		reAddClass(s, c);
+		break;
+	case 't':
+		reAddByte(s, '\t');
+		break;
+	case 'r':
+		reAddByte(s, '\r');
+		break;
+	default:
+		reAddByte(s, c);
+		break;
+	}
+}
+
+static int reParseClass(struct reparser *ps)
+{
+	int n = reNewSet(ps);
+	struct reset *s = &ps->re->sets[ps->nodes[n].set];
+	int neg = (*ps->p == '^');
+	if (neg)
+		++ps->p;
+
+	for (int first = 1; *ps->p && (*ps->p != ']' || first); first = 0)
+	{
+		unsigned char lo = *ps->p++;
+		if (lo == '\\')
+		{
+			if (*ps->p && strchr("dDwWsS", *ps->p))
+			{
+				reAddClass(s, *ps->p++);
+				continue;
+			}
+			struct reset one = { { 0 } };
+			reEscape(ps, &one);
+			if (ps->err)
+				return n;
+			for (lo = 0; !reInSet(&one, lo); ++lo)
+				;
+		}
+
+		unsigned char hi = lo;
+		if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']')
+		{
+			hi = ps->p[1];
+			ps->p += 2;
+			if (hi == '\\')
+				hi = *ps->p ? *ps->p++ : 0;
+			if (hi < lo)
+			{
+				ps->err = 1;
+				return n;
+			}
+		}
+		for (int c = lo; c <= hi; ++c)
+			reAddByte(s, c);
+	}
+
+	if (*ps->p != ']')
+	{
+		ps->err = 1;
+		return n;
+	}
+	++ps->p;
+
+	if (neg)
+		for (int i = 0; i < 32; ++i)
+			s->bits[i] = ~s->bits[i];
+	s->bits['\n' >> 3] &= ~(1 << ('\n' & 7));
+	return n;
+}
+
+static int reParseAlt(struct reparser *ps, int depth);
+
+static int reParseAtom(struct reparser *ps, int depth)
+{
+	int n;
+	char c = *ps->p++;
+	switch (c)
+	{
+	case '(':
+		if (depth == KILO_RE_MAXDEPTH)
+		{
+			ps->err = 1;
+			return -1;
+		}
+		if (ps->p[0] == '?' && ps->p[1] == ':')
+			ps->p += 2;
+		n = reParseAlt(ps, depth + 1);
+		if (*ps->p != ')')
+			ps->err = 1;
+		else
+			++ps->p;
+		return n;
+	case '[':
+		return reParseClass(ps);
+	case '^':
+		return reNode(ps, N_BOL, -1, -1);
+	case '$':
+		return reNode(ps, N_EOL, -1, -1);
+	case '*': case '+': case '?':
+		ps->err = 1; // nothing to repeat
+		return -1;
+	case '.':
+		n = reNewSet(ps);
+		for (int i = 0; i < 256; ++i)
+			if (i != '\n')
+				reAddByte(&ps->re->sets[ps->nodes[n].set], i);
+		return n;
+	case '\\':
+		n = reNewSet(ps);
+		reEscape(ps, &ps->re->sets[ps->nodes[n].set]);
+		return n;
+	default:
+		n = reNewSet(ps);
+		reAddByte(&ps->re->sets[ps->nodes[n].set], c);
+		return n;
+	}
+}
+
+/* Reads the counts of x{n}, x{n,} or x{n,m}, and returns 0 if there are
+   none, in which case the brace is taken literally. */
+static int reParseCount(struct reparser *ps, int *min, int *max)
+{
+	char *p = (char *)ps->p + 1;
+	if (!isdigit((unsigned char)*p))
+		return 0;
+	long lo = strtol(p, &p, 10);
+	long hi = lo;
+	if (*p == ',')
+	{
+		++p;
+		hi = isdigit((unsigned char)*p) ? strtol(p, &p, 10) : -1;
+	}
+	if (*p != '}')
+		return 0;
+
+	if (lo > KILO_RE_MAXREP || hi > KILO_RE_MAXREP || (hi != -1 && hi < lo))
+		ps->err = 1;
+	*min = lo;
+	*max = hi;
+	ps->p = p + 1;
+	return 1;
+}
+
+static int reParseRepeat(struct reparser *ps, int depth)
+{
+	int n = reParseAtom(ps, depth);
+	while (!ps->err)
+	{
+		int min, max;
+		char c = *ps->p;
+		if (c == '*')
+			min = 0, max = -1;
+		else if (c == '+')
+			min = 1, max = -1;
+		else if (c == '?')
+			min = 0, max = 1;
+		else if (c != '{' || !reParseCount(ps, &min, &max))
+			break;
+		if (c != '{')
+			++ps->p;
+
+		int greedy = 1;
+		if (*ps->p == '?')
+		{
+			greedy = 0;
+			++ps->p;
+		}
+		n = reNode(ps, N_REP, n, -1);
+		ps->nodes[n].min = min;
+		ps->nodes[n].max = max;
+		ps->nodes[n].greedy = greedy;
+	}
+	return n;
+}
+
+static int reParseCat(struct reparser *ps, int depth)
+{
+	int n = -1;
+	while (!ps->err && *ps->p && *ps->p != '|' && *ps->p != ')')
+	{
+		int a = reParseRepeat(ps, depth);
+		n = (n == -1) ? a : reNode(ps, N_CAT, n, a);
+	}
+	return (n == -1) ? reNode(ps, N_EMPTY, -1, -1) : n;
+}
+
+static int reParseAlt(struct reparser *ps, int depth)
+{
+	int n = reParseCat(ps, depth);
+	while (!ps->err && *ps->p == '|')
+	{
+		++ps->p;
+		int r = reParseCat(ps, depth);
+		n = reNode(ps, N_ALT, n, r);
+	}
+	return n;
+}
+
+/*** compiling ***/
+
+static int reInst(regex *re, int op)
+{
+	if (re->nprog == KILO_RE_MAXPROG)
+		return -1;
+	if ((re->nprog & (re->nprog - 1)) == 0)
+		re->prog = realloc(re->prog, sizeof(struct reinst) * (re->nprog ? re->nprog * 2 : 1));
+	struct reinst *in = &re->prog[re->nprog];
+	in->op = op;
+	in->x = in->y = in->set = 0;
+	return re->nprog++;
+}
+
+static void reSplit(regex *re, int at, int to, int other, int greedy)
+{
+	re->prog[at].x = greedy ? to : other;
+	re->prog[at].y = greedy ? other : to;
+}
+
+/* Appends the code of node n, returns 0 when the program grows too big. */
+static int reEmit(regex *re, const struct renode *nodes, int n)
+{
+	const struct renode *nd = &nodes[n];
+	int at, j;
+
+	switch (nd->type)
+	{
+	case N_EMPTY:
+		return 1;
+	case N_SET:
+		if ((at = reInst(re, RE_BYTE)) < 0)
+			return 0;
+		re->prog[at].set = nd->set;
+		return 1;
+	case N_BOL:
+		return reInst(re, RE_BOL) >= 0;
+	case N_EOL:
+		return reInst(re, RE_EOL) >= 0;
+	case N_CAT:
+		return reEmit(re, nodes, nd->l) && reEmit(re, nodes, nd->r);
+	case N_ALT:
+		if ((at = reInst(re, RE_SPLIT)) < 0 || !reEmit(re, nodes, nd->l) ||
+			(j = reInst(re, RE_JMP)) < 0)
+			return 0;
+		re->prog[at].x = at + 1;
+		re->prog[at].y = re->nprog;
+		if (!reEmit(re, nodes, nd->r))
+			return 0;
+		re->prog[j].x = re->nprog;
+		return 1;
+	}
+
+	// N_REP: x{min} first, then x* or up to max - min optional x
+	for (int i = 0; i < nd->min - (nd->max == -1 && nd->min > 0); ++i)
+		if (!reEmit(re, nodes, nd->l))
+			return 0;
+
+	if (nd->max == -1 && nd->min > 0)
+	{
+		// the last x, and back to it
+		int first = re->nprog;
+		if (!reEmit(re, nodes, nd->l) || (at = reInst(re, RE_SPLIT)) < 0)
+			return 0;
+		reSplit(re, at, first, re->nprog, nd->greedy);
+	}
+	else if (nd->max == -1)
+	{
+		if ((at = reInst(re, RE_SPLIT)) < 0 || !reEmit(re, nodes, nd->l) ||
+			(j = reInst(re, RE_JMP)) < 0)
+			return 0;
+		re->prog[j].x = at;
+		reSplit(re, at, at + 1, re->nprog, nd->greedy);
+	}
+	else
+	{
+		// each optional x may skip to the end; until it is known, the
+		// splits are chained through y
+		int chain = -1;
+		for (int i = nd->min; i < nd->max; ++i)
+		{
+			if ((at = reInst(re, RE_SPLIT)) < 0)
+				return 0;
+			re->prog[at].y = chain;
+			chain = at;
+			if (!reEmit(re, nodes, nd->l))
+				return 0;
+		}
+		while (chain != -1)
+		{
+			int prev = re->prog[chain].y;
+			reSplit(re, chain, chain + 1, re->nprog, nd->greedy);
+			chain = prev;
+		}
+	}
+	return 1;
+}
+
+static int reByte(const regex *re, const struct renode *nd)
+{
+	if (nd->type != N_SET)
+		return -1;
+	int byte = -1;
+	for (int c = 0; c < 256; ++c)
+	{
+		if (!reInSet(&re->sets[nd->set], c))
+			continue;
+		if (byte != -1)
+			return -1;
+		byte = c;
+	}
+	return byte;
+}
+
+static void reMustRun(regex *re, const char *run, int len)
+{
+	if (len > re->mustlen)
+	{
+		memcpy(re->must, run, len);
+		re->mustlen = len;
+	}
+}
+
+/* Looks for the longest run of single bytes that node n cannot match
+   without, continuing the run of *len bytes in front of it. */
+static void reMust(regex *re, const struct renode *nodes, int n, char *run, int *len)
+{
+	const struct renode *nd = &nodes[n];
+	int c;
+
+	if (nd->type == N_CAT)
+	{
+		reMust(re, nodes, nd->l, run, len);
+		reMust(re, nodes, nd->r, run, len);
+		return;
+	}
+	if ((c = reByte(re, nd)) != -1)
+	{
+		run[(*len)++] = c;
+		return;
+	}
+
+	reMustRun(re, run, *len);
+	*len = 0;
+	if (nd->type == N_REP && nd->min > 0)
+	{
+		reMust(re, nodes, nd->l, run, len);
+		reMustRun(re, run, *len);
+		*len = 0;
+	}
+}
+
+/* Returns the compiled pattern, or NULL when it is malformed or too big. */
+regex *reCompile(const char *pattern)
+{
+	regex *re = calloc(1, sizeof(regex));
+	struct reparser ps = { .p = pattern, .re = re };
+
+	int root = reParseAlt(&ps, 0);
+	if (!ps.err && *ps.p == ')')
+		ps.err = 1;
+	if (ps.err || !reEmit(re, ps.nodes, root) || reInst(re, RE_MATCH) < 0)
+	{
+		free(ps.nodes);
+		reFree(re);
+		return NULL;
+	}
+
+	char *run = malloc(strlen(pattern) + 1);
+	int runlen = 0;
+	re->must = malloc(strlen(pattern) + 1);
+	reMust(re, ps.nodes, root, run, &runlen);
+	reMustRun(re, run, runlen);
+	free(run);
+	free(ps.nodes);
+
+	re->mark = calloc(re->nprog, sizeof(unsigned int));
+	re->stack = malloc(sizeof(int) * (re->nprog * 3 + 1));
+	re->seeds = malloc(sizeof(int) * (re->nprog + 1));
+	re->follow = malloc(sizeof(int) * re->nprog);
+	re->clist = malloc(sizeof(struct rethread) * re->nprog);
+	re->nlist = malloc(sizeof(struct rethread) * re->nprog);
+	re->start = -1;
+	return re;
+}
+
+void reFree(regex *re)
+{
+	if (re == NULL)
+		return;
+	free(re->prog);
+	free(re->sets);
+	free(re->must);
+	free(re->states);
+	free(re->pool);
+	free(re->mark);
+	free(re->stack);
+	free(re->seeds);
+	free(re->follow);
+	free(re->clist);
+	free(re->nlist);
+	free(re->groups);
+	free(re);
+}
+
+/*** following ***/
+
+static void reNextGen(regex *re)
+{
+	if (++re->gen == 0)
+	{
+		memset(re->mark, 0, sizeof(unsigned int) * re->nprog);
+		re->gen = 1;
+	}
+}
+
+/* Follows the jumps from the seeds, first ones first, and puts the
+   instructions reached that consume a byte or end the match in out. The
+   end of the line is either known to be here (eol 1), known not to be
+   (eol 0), or not known yet (eol -1), in which case the '$' instructions
+   are put in out as well. Instructions already marked in this generation
+   are skipped. */
+static int reFollow(regex *re, const int *seeds, int nseeds, int bol, int eol, int *out)
+{
+	int n = 0;
+	int sp = 0;
+	for (int i = nseeds - 1; i >= 0; --i)
+		re->stack[sp++] = seeds[i];
+
+	while (sp > 0)
+	{
+		int pc = re->stack[--sp];
+		if (re->mark[pc] == re->gen)
+			continue;
+		re->mark[pc] = re->gen;
+
+		struct reinst *in = &re->prog[pc];
+		switch (in->op)
+		{
+		case RE_JMP:
+			re->stack[sp++] = in->x;
+			break;
+		case RE_SPLIT:
+			re->stack[sp++] = in->y;
+			re->stack[sp++] = in->x;
+			break;
+		case RE_BOL:
+			if (bol)
+				re->stack[sp++] = pc + 1;
+			break;
+		case RE_EOL:
+			if (eol == 1)
+				re->stack[sp++] = pc + 1;
+			else if (eol == -1)
+				out[n++] = pc;
+			break;
+		default:
+			out[n++] = pc;
+			break;
+		}
+	}
+	return n;
+}
+
+/*** lazy DFA ***/
+
+static int reCompareInt(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static void reFlush(regex *re)
+{
+	re->nstates = 0;
+	re->npool = 0;
+	re->start = -1;
+	++re->flushes;
+	memset(re->table, 0, sizeof(re->table));
+}
+
+/* Returns the state of the instructions pcs, adding it when it is new. */
+static int reState(regex *re, int *pcs, int n, int bol)
+{
+	qsort(pcs, n, sizeof(int), reCompareInt);
+	unsigned int h = 2166136261u ^ bol;
+	for (int i = 0; i < n; ++i)
+		h = (h ^ pcs[i]) * 16777619u;
+
+	unsigned int mask = KILO_RE_STATES * 2 - 1;
+	unsigned int slot;
+	for (slot = h & mask; re->table[slot]; slot = (slot + 1) & mask)
+	{
+		struct restate *st = &re->states[re->table[slot] - 1];
+		if (st->bol == bol && st->n == n &&
+			!memcmp(&re->pool[st->off], pcs, sizeof(int) * n))
+			return re->table[slot] - 1;
+	}
+
+	if (re->nstates == KILO_RE_STATES)
+	{
+		reFlush(re);
+		for (slot = h & mask; re->table[slot]; slot = (slot + 1) & mask)
+			;
+	}
+	if (re->nstates == re->capstates)
+	{
+		re->capstates = re->capstates ? re->capstates * 2 : 16;
+		re->states = realloc(re->states, sizeof(struct restate) * re->capstates);
+	}
+	if (re->npool + n > re->cappool)
+	{
+		re->cappool = (re->npool + n) * 2;
+		re->pool = realloc(re->pool, sizeof(int) * re->cappool);
+	}
+
+	struct restate *st = &re->states[re->nstates];
+	memcpy(&re->pool[re->npool], pcs, sizeof(int) * n);
+	st->off = re->npool;
+	st->n = n;
+	st->bol = bol;
+	re->npool += n;
+
+	st->match = 0;
+	int neol = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		if (re->prog[pcs[i]].op == RE_MATCH)
+			st->match = 1;
+		else if (re->prog[pcs[i]].op == RE_EOL)
+			re->seeds[neol++] = pcs[i] + 1;
+	}
+	st->eolmatch = st->match;
+	if (!st->match && neol)
+	{
+		reNextGen(re);
+		int m = reFollow(re, re->seeds, neol, bol, 1, re->follow);
+		for (int i = 0; i < m; ++i)
+			if (re->prog[re->follow[i]].op == RE_MATCH)
+				st->eolmatch = 1;
+	}
+
+	// the lines end at newlines, and at carriage returns before them, so
+	// those bytes are never looked up; neither is anything after a match
+	for (int c = 0; c < 256; ++c)
+		st->next[c] = st->match ? -2 : -1;
+	st->next['\n'] = st->next['\r'] = -2;
+
+	re->table[slot] = re->nstates + 1;
+	return re->nstates++;
+}
+
+static int reStartState(regex *re)
+{
+	if (re->start < 0)
+	{
+		int seed = 0;
+		reNextGen(re);
+		int n = reFollow(re, &seed, 1, 1, -1, re->follow);
+		re->start = reState(re, re->follow, n, 1);
+	}
+	return re->start;
+}
+
+/* Returns the state after byte c in state s. A search may also begin at
+   every byte, so the start of the program is always followed as well. */
+static int reStep(regex *re, int s, unsigned char c)
+{
+	struct restate *st = &re->states[s];
+	int n = 0;
+	for (int i = 0; i < st->n; ++i)
+	{
+		struct reinst *in = &re->prog[re->pool[st->off + i]];
+		if (in->op == RE_BYTE && reInSet(&re->sets[in->set], c))
+			re->seeds[n++] = re->pool[st->off + i] + 1;
+	}
+	re->seeds[n++] = 0;
+
+	reNextGen(re);
+	int m = reFollow(re, re->seeds, n, 0, -1, re->follow);
+	unsigned int flushes = re->flushes;
+	int t = reState(re, re->follow, m, 0);
+	// s is gone if the cache was emptied, and a carriage return is only
+	// stepped over when it is not at the end of the line
+	if (re->flushes == flushes && c != '\r')
+		re->states[s].next[c] = t;
+	return t;
+}
+
+static const char *reScanLines(regex *re, const char *p, const char *end)
+{
+	const char *line = p;
+	int s = reStartState(re);
+
+	while (p < end)
+	{
+		int t = re->states[s].next[(unsigned char)*p];
+		if (t >= 0)
+		{
+			s = t;
+			++p;
+			continue;
+		}
+
+		if (re->states[s].match)
+			return line;
+
+		const char *q = p;
+		while (q < end && *q == '\r')
+			++q;
+		if (q == end || *q == '\n')
+		{
+			if (re->states[s].eolmatch)
+				return line;
+			if (q == end)
+				return NULL;
+			p = line = q + 1;
+			s = reStartState(re);
+			continue;
+		}
+
+		s = reStep(re, s, *p++);
+	}
+	return (re->states[s].eolmatch) ? line : NULL;
+}
+
+/* Returns the start of the first line in p that holds a match, or NULL.
+   The lines are separated by newlines, which may follow carriage returns
+   that are not part of them. */
+const char *reFindLine(regex *re, const char *p, size_t len)
+{
+	const char *end = p + len;
+	if (re->mustlen == 0)
+		return reScanLines(re, p, end);
+
+	const char *m;
+	while ((m = scanFind(p, end - p, re->must, re->mustlen)) != NULL)
+	{
+		const char *line = memrchr(p, '\n', m - p);
+		line = line ? line + 1 : p;
+		const char *eol = memchr(m, '\n', end - m);
+		if (eol == NULL)
+			eol = end;
+
+		if (reScanLines(re, line, eol))
+			return line;
+		if (eol == end)
+			break;
+		p = eol + 1;
+	}
+	return NULL;
+}
+
+/*** Pike VM ***/
+
+static int reAddThread(regex *re, struct rethread *list, int pc, int start, int pos, int len)
+{
+	int n = reFollow(re, &pc, 1, pos == 0, pos == len, re->follow);
+	for (int i = 0; i < n; ++i)
+	{
+		list[i].pc = re->follow[i];
+		list[i].start = start;
+	}
+	return n;
+}
+
+/* Finds the leftmost match in the line s that begins at 'from' or after,
+   and returns where it begins, or -1 if there is none. */
+int reMatch(regex *re, const char *s, int len, int from, int *mlen)
+{
+	struct rethread *clist = re->clist, *nlist = re->nlist;
+	int nc = 0;
+	int mstart = -1, mend = 0;
+
+	reNextGen(re);
+	for (int i = from; ; ++i)
+	{
+		// a match beginning here has the lowest priority
+		if (mstart < 0)
+			nc += reAddThread(re, &clist[nc], 0, i, i, len);
+		else if (nc == 0)
+			break;
+
+		reNextGen(re);
+		int nn = 0;
+		for (int t = 0; t < nc; ++t)
+		{
+			struct reinst *in = &re->prog[clist[t].pc];
+			if (in->op == RE_MATCH)
+			{
+				// the threads after this one are less preferred
+				mstart = clist[t].start;
+				mend = i;
+				break;
+			}
+			if (i < len && reInSet(&re->sets[in->set], s[i]))
+				nn += reAddThread(re, &nlist[nn], clist[t].pc + 1, clist[t].start, i + 1, len);
+		}
+
+		struct rethread *tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		nc = nn;
+		if (i == len)
+			break;
+	}
+
+	*mlen = mend - mstart;
+	return mstart;
+}
+
+static struct regroup *reNewGroup(regex *re, int n, int lo)
+{
+	if (n == re->capgroups)
+	{
+		re->capgroups = re->capgroups ? re->capgroups * 2 : 16;
+		re->groups = realloc(re->groups, sizeof(struct regroup) * re->capgroups);
+	}
+	re->groups[n].lo = lo;
+	re->groups[n].end = -1;
+	return &re->groups[n];
+}
+
+/* Calls found() for each match that reMatch() would find in the line s from
+   0 on, going on after the end of the one before or a byte after an empty
+   one. */
+void reMatchAll(regex *re, const char *s, int len,
+	void (*found)(void *arg, int start, int len), void *arg)
+{
+	struct rethread *clist = re->clist, *nlist = re->nlist;
+	int nc = 0;
+
+	// the first group whose match is not known yet, and the one after the
+	// last; all but the last have a match already
+	int head = 0, ngroups = 1;
+	reNewGroup(re, 0, 0);
+
+	reNextGen(re);
+	for (int i = 0; ; ++i)
+	{
+		struct regroup *last = &re->groups[ngroups - 1];
+		if (last->lo <= i)
+			nc += reAddThread(re, &clist[nc], 0, i, i, len);
+
+		int t = 0;
+		while (1)
+		{
+			while (t < nc && re->prog[clist[t].pc].op != RE_MATCH)
+				++t;
+			if (t == nc)
+				break;
+
+			// the threads after this one are less preferred, or begin
+			// inside its match, and so are the groups after its own
+			int g = ngroups - 1;
+			while (re->groups[g].lo > clist[t].start)
+				--g;
+			re->groups[g].start = clist[t].start;
+			re->groups[g].end = i;
+			ngroups = g + 1;
+			nc = t;
+
+			last = reNewGroup(re, ngroups++, (i > clist[t].start) ? i : i + 1);
+			if (last->lo == i)
+			{
+				// a match beginning here comes last again
+				reNextGen(re);
+				for (int k = 0; k < nc; ++k)
+					re->mark[clist[k].pc] = re->gen;
+				nc += reAddThread(re, &clist[nc], 0, i, i, len);
+			}
+		}
+		if (i == len)
+			break;
+
+		reNextGen(re);
+		int nn = 0;
+		for (t = 0; t < nc; ++t)
+		{
+			struct reinst *in = &re->prog[clist[t].pc];
+			if (reInSet(&re->sets[in->set], s[i]))
+				nn += reAddThread(re, &nlist[nn], clist[t].pc + 1, clist[t].start, i + 1, len);
+		}
+
+		struct rethread *tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		nc = nn;
+
+		// a match is known once no thread that could make it longer or
+		// begin it sooner is left; the threads are in order of their start
+		while (head < ngroups - 1 && (nc == 0 || clist[0].start >= re->groups[head + 1].lo))
+		{
+			found(arg, re->groups[head].start, re->groups[head].end - re->groups[head].start);
+			++head;
+		}
+		if (nc == 0 && re->groups[ngroups - 1].lo > len)
+			break;
+	}
+
+	for (; head < ngroups - 1; ++head)
+		found(arg, re->groups[head].start, re->groups[head].end - re->groups[head].start);
+}
@@ -3,11 +3,82 @@
 #include "../include/row.h"
 #include "../include/editor.h"
 #include "../include/highlight.h"
+#include "../include/ptable.h"
+#include "../include/undo.h"
 
 #define KILO_TAB_STOP 8
+#define KILO_GAP_MIN 16
 
 extern struct editorConfig E;
 
+/*** gap buffer ***/
+
+/*
+ * A row that has been edited owns its chars as a gap buffer: the text is
+ * chars[0, gap) followed by chars[gap + gaplen, size + gaplen). The gap is
+ * moved to wherever the row is edited, so runs of typing and deleting at the
+ * cursor only touch the allocator when the gap is used up.
+ */
+
+static char editorRowCharAt(erow *row, int at)
+{
+	return row->chars[at < row->gap ? at : at + row->gaplen];
+}
+
+static void editorRowMoveGap(erow *row, int at)
+{
+	if (at < row->gap)
+		memmove(&row->chars[at + row->gaplen], &row->chars[at], row->gap - at);
+	else if (at > row->gap)
+		memmove(&row->chars[row->gap], &row->chars[row->gap + row->gaplen],
+			at - row->gap);
+	row->gap = at;
+}
+
+/* Places the gap at 'at' and makes it at least 'len' bytes long. */
+static void editorRowMakeGap(erow *row, int at, int len)
+{
+	if (row->owned && row->gaplen >= len)
+	{
+		editorRowMoveGap(row, at);
+		return;
+	}
+
+	int gaplen = len + row->size / 2 + KILO_GAP_MIN;
+	char *chars = malloc(row->size + gaplen);
+	int tail = row->gap + row->gaplen;
+
+	if (at <= row->gap)
+	{
+		memcpy(chars, row->chars, at);
+		memcpy(&chars[at + gaplen], &row->chars[at], row->gap - at);
+		memcpy(&chars[row->gap + gaplen], &row->chars[tail], row->size - row->gap);
+	}
+	else
+	{
+		memcpy(chars, row->chars, row->gap);
+		memcpy(&chars[row->gap], &row->chars[tail], at - row->gap);
+		memcpy(&chars[at + gaplen], &row->chars[tail + at - row->gap], row->size - at);
+	}
+
+	if (row->owned)
+		free(row->chars);
+	row->chars = chars;
+	row->owned = 1;
+	row->gap = at;
+	row->gaplen = gaplen;
+}
+
+/* Returns the text of the row from 'at' on as one contiguous run. */
+char *editorRowCharsFrom(erow *row, int at)
+{
+	if (row->gaplen == 0)
+		return &row->chars[at];
+	if (row->gap > at)
+		editorRowMoveGap(row, at);
+	return &row->chars[at + row->gaplen];
+}
+
 /*** row operations ***/
 
 int editorRowCxToRx(erow *row, int cx)
@@ -15,7 +86,7 @@ int editorRowCxToRx(erow *row, int cx)
 	int rx = 0;
 	for (int i = 0; i < cx; ++i)
 	{
-		if (row->chars[i] == '\t')
+		if (editorRowCharAt(row, i) == '\t')
 			rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
 		++rx;
 	}
@@ -28,7 +99,7 @@ int editorRowRxToCx(erow *row, int rx)
 	int cx;
 	for (cx = 0; cx < row->size; ++cx)
 	{
-		if (row->chars[cx] == '\t')
+		if (editorRowCharAt(row, cx) == '\t')
 			cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
 		++cur_rx;
 
@@ -38,19 +109,27 @@ int editorRowRxToCx(erow *row, int rx)
 	return cx;
 }
 
-void editorUpdateRow(erow *row)
+static void editorRenderRow(erow *row)
 {
 	int tabs = 0;
 	for (int j = 0; j < row->size; ++j)
-		if (row->chars[j] == '\t') ++tabs;
+		if (editorRowCharAt(row, j) == '\t') ++tabs;
 
-	free(row->render);
-	row->render = malloc(row->size + tabs*(KILO_TAB_STOP - 1) + 1);
+	// render and hl keep their capacity, so they are only reallocated
+	// when the row grows past it
+	int need = row->size + tabs*(KILO_TAB_STOP - 1) + 1;
+	if (need > row->rcap)
+	{
+		row->rcap = (need > row->rcap * 2) ? need : row->rcap * 2;
+		row->render = realloc(row->render, row->rcap);
+		row->hl = realloc(row->hl, row->rcap);
+	}
 
 	int idx = 0;
 	for (int j = 0; j < row->size; ++j)
 	{
-		if (row->chars[j] == '\t')
+		char c = editorRowCharAt(row, j);
+		if (c == '\t')
 		{
 			row->render[idx++] = ' ';
 			while (idx % KILO_TAB_STOP != 0)
@@ -58,13 +137,44 @@ void editorUpdateRow(erow *row)
 		}
 		else
 		{
-			row->render[idx++] = row->chars[j];
+			row->render[idx++] = c;
 		}
 	}
 	row->render[idx] = '\0';
 	row->rsize = idx;
+	row->stale = 0;
+	row->hl_state = -1;
+}
+
+/* Returns row at with its render up to date. Edits only mark rows stale, so
+   the work is done here, for the rows that are drawn or searched. */
+erow *editorRenderedRow(int at)
+{
+	erow *row = ptRow(at);
+	if (row && (row->render == NULL || row->stale))
+		editorRenderRow(row);
+	return row;
+}
 
-	editorUpdateSyntax(row);
+/* Returns row at with its render and hl up to date. */
+erow *editorRow(int at)
+{
+	erow *row = editorRenderedRow(at);
+	if (row)
+		editorUpdateSyntax(row, at);
+	return row;
+}
+
+void editorInvalidateRow(erow *row)
+{
+	row->hl_state = -1;
+}
+
+void editorUpdateRow(erow *row)
+{
+	row->stale = 1;
+	if (E.syntax)
+		editorHighlightEdited(ptRowIndex(row));
 }
 
 void editorInsertRow(int at, char *s, size_t len)
@@ -72,44 +182,47 @@ void editorInsertRow(int at, char *s, size_t len)
 	if (at < 0 || at > E.numrows)
 		return;
 
-	E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-	memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at));
-	for (int j = at + 1; j <= E.numrows; ++j)
-		E.row[j].idx++;
+	editorJournalInsertRows(at, s, len, 1);
+	erow *row = ptInsertRow(at, s, len);
+	editorHighlightShift(at, 1);
+	editorUpdateRow(row);
 
-	E.row[at].idx = at;
+	++E.numrows;
+	++E.dirty;
+}
 
-	E.row[at].size = len;
-	E.row[at].chars = malloc(len + 1);
-	memcpy(E.row[at].chars, s, len);
-	E.row[at].chars[len] = '\0';
+/* Inserts the newline separated lines of s as rows from 'at' on, in one
+   edit of the piece table. Returns the number of rows. */
+int editorInsertRows(int at, char *s, size_t len)
+{
+	if (at < 0 || at > E.numrows)
+		return 0;
 
-	E.row[at].rsize = 0;
-	E.row[at].render = NULL;
-	E.row[at].hl = NULL;
-	E.row[at].hl_open_comment = 0;
-	editorUpdateRow(&E.row[at]);
+	int n = ptInsertRows(at, s, len);
+	editorJournalInsertRows(at, s, len, n);
+	editorHighlightShift(at, n);
+	editorHighlightEdited(at);
+	editorHighlightEdited(at + n - 1);
 
-	++E.numrows;
+	E.numrows += n;
 	++E.dirty;
+	return n;
 }
 
-void editorFreeRow(erow *row)
+void editorDelRow(int at)
 {
-	free(row->render);
-	free(row->chars);
-	free(row->hl);
+	editorDelRows(at, 1);
 }
 
-void editorDelRow(int at)
+void editorDelRows(int at, int n)
 {
-	if (at < 0 || at >= E.numrows)
+	if (at < 0 || n <= 0 || at + n > E.numrows)
 		return;
-	editorFreeRow(&E.row[at]);
-	memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-	for (int j = at; j < E.numrows - 1; ++j)
-		E.row[j].idx--;
-	E.numrows--;
+	editorJournalDeleteRows(at, n);
+	ptDelRows(at, n);
+	editorHighlightShift(at, -n);
+	editorHighlightEdited(at);
+	E.numrows -= n;
 	E.dirty++;
 }
 
@@ -117,20 +230,31 @@ void editorRowInsertChar(erow *row, int at, int c)
 {
 	if (at < 0 || at > row->size)
 		at = row->size;
-	row->chars = realloc(row->chars, row->size + 2);
-	memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+	char ch = c;
+	editorJournalInsert(ptRowIndex(row), at, &ch, 1, 1);
+	editorRowMakeGap(row, at, 1);
+	row->chars[row->gap++] = c;
+	row->gaplen--;
 	row->size++;
-	row->chars[at] = c;
 	editorUpdateRow(row);
 	++E.dirty;
 }
 
 void editorRowAppendString(erow *row, char *s, size_t len)
 {
-	row->chars = realloc(row->chars, row->size + len + 1);
-	memcpy(&row->chars[row->size], s, len);
+	editorRowInsertString(row, row->size, s, len);
+}
+
+void editorRowInsertString(erow *row, int at, char *s, size_t len)
+{
+	if (at < 0 || at > row->size)
+		at = row->size;
+	editorJournalInsert(ptRowIndex(row), at, s, len, 0);
+	editorRowMakeGap(row, at, len);
+	memcpy(&row->chars[row->gap], s, len);
+	row->gap += len;
+	row->gaplen -= len;
 	row->size += len;
-	row->chars[row->size] = '\0';
 	editorUpdateRow(row);
 	++E.dirty;
 }
@@ -139,8 +263,82 @@ void editorRowDelChar(erow *row, int at)
 {
 	if (at < 0 || at >= row->size)
 		return;
-	memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+	char c = editorRowCharAt(row, at);
+	editorJournalDelete(ptRowIndex(row), at, &c, 1, 1);
+	editorRowMakeGap(row, at, 0);
+	row->gaplen++;
 	row->size--;
 	editorUpdateRow(row);
 	++E.dirty;
-}
\ No newline at end of file
+}
+
+void editorRowDelString(erow *row, int at, int len)
+{
+	if (at < 0 || len <= 0 || at + len > row->size)
+		return;
+	editorJournalDelete(ptRowIndex(row), at, editorRowCharsFrom(row, at), len, 0);
+	editorRowMakeGap(row, at, 0);
+	row->gaplen += len;
+	row->size -= len;
+	editorUpdateRow(row);
+	++E.dirty;
+}
+
+void editorRowTruncate(erow *row, int at)
+{
+	if (at < 0 || at >= row->size)
+		return;
+	editorJournalDelete(ptRowIndex(row), at, editorRowCharsFrom(row, at),
+		row->size - at, 0);
+	if (row->owned)
+	{
+		editorRowMoveGap(row, at);
+		row->gaplen += row->size - at;
+	}
+	else
+	{
+		row->gap = at;
+	}
+	row->size = at;
+	editorUpdateRow(row);
+}
+
+/* Makes the edits, which are in document order and do not overlap, with
+   each row they touch rewritten once. */
+void editorRowsReplace(const struct rowEdit *edits, int n)
+{
+	if (n == 0)
+		return;
+	editorJournalReplace(edits, n);
+
+	for (int i = 0, j; i < n; i = j)
+	{
+		erow *row = ptRow(edits[i].row);
+		int size = row->size;
+		for (j = i; j < n && edits[j].row == edits[i].row; ++j)
+			size += edits[j].slen - edits[j].len;
+
+		char *old = editorRowCharsFrom(row, 0);
+		char *chars = malloc(size + KILO_GAP_MIN);
+		int from = 0, to = 0;
+		for (int k = i; k < j; ++k)
+		{
+			memcpy(&chars[to], &old[from], edits[k].col - from);
+			to += edits[k].col - from;
+			memcpy(&chars[to], edits[k].s, edits[k].slen);
+			to += edits[k].slen;
+			from = edits[k].col + edits[k].len;
+		}
+		memcpy(&chars[to], &old[from], row->size - from);
+
+		if (row->owned)
+			free(row->chars);
+		row->chars = chars;
+		row->owned = 1;
+		row->size = size;
+		row->gap = size;
+		row->gaplen = KILO_GAP_MIN;
+		editorUpdateRow(row);
+	}
+	++E.dirty;
+}
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "../include/scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+/*** newline scanning ***/
+
+/*
+ * Counting newlines is what indexing a file comes down to. The vector
+ * versions compare 16 or 32 bytes at a time and accumulate the matches
+ * bytewise, folding the byte counters into a total before they can wrap.
+ * The AVX2 one is picked at run time when the CPU has it.
+ */
+
+static size_t scanCountLinesScalar(const char *p, size_t len)
+{
+	const char *end = p + len;
+	size_t n = 0;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL)
+	{
+		++n;
+		++p;
+	}
+	return n;
+}
+
+#ifdef SCAN_X86
+
+static size_t scanCountLinesSSE2(const char *p, size_t len)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+	size_t n = 0;
+	size_t i = 0;
+
+	while (i + 16 <= len)
+	{
+		__m128i acc = _mm_setzero_si128();
+		for (int k = 0; k < 255 && i + 16 <= len; ++k, i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)&p[i]);
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+		}
+		__m128i sum = _mm_sad_epu8(acc, zero);
+		n += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+	}
+	return n + scanCountLinesScalar(&p[i], len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scanCountLinesAVX2(const char *p, size_t len)
+{
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i zero = _mm256_setzero_si256();
+	size_t n = 0;
+	size_t i = 0;
+
+	while (i + 32 <= len)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		for (int k = 0; k < 255 && i + 32 <= len; ++k, i += 32)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i *)&p[i]);
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
+		}
+		__m256i sum = _mm256_sad_epu8(acc, zero);
+		n += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+			_mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+	}
+	return n + scanCountLinesSSE2(&p[i], len - i);
+}
+
+#endif
+
+size_t scanCountLines(const char *p, size_t len)
+{
+#ifdef SCAN_X86
+	if (__builtin_cpu_supports("avx2"))
+		return scanCountLinesAVX2(p, len);
+	return scanCountLinesSSE2(p, len);
+#else
+	return scanCountLinesScalar(p, len);
+#endif
+}
+
+/* Returns the position just past the n-th newline in p, which must have at
+   least n of them. Whole 16 byte runs are skipped by counting. */
+const char *scanSkipLines(const char *p, size_t len, size_t n)
+{
+	const char *end = p + len;
+
+#ifdef SCAN_X86
+	const __m128i nl = _mm_set1_epi8('\n');
+	while (n > 16 && end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		n -= __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+		p += 16;
+	}
+#endif
+	while (n > 0)
+	{
+		p = (const char *)memchr(p, '\n', end - p) + 1;
+		--n;
+	}
+	return p;
+}
+
+/*** substring search ***/
+
+/*
+ * The vector versions look for the first and the last byte of the needle at
+ * 16 or 32 positions at once, and only compare the whole needle where both
+ * are in place, which in text is rarely more than once a vector.
+ */
+
+#ifdef SCAN_X86
+
+static const char *scanFindSSE2(const char *p, size_t len, const char *needle,
+	size_t m)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+
+	while (i + m + 15 <= len)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)&p[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&p[i + m - 1]);
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		while (mask)
+		{
+			int k = __builtin_ctz(mask);
+			if (memcmp(&p[i + k], needle, m) == 0)
+				return &p[i + k];
+			mask &= mask - 1;
+		}
+		i += 16;
+	}
+	return memmem(&p[i], len - i, needle, m);
+}
+
+__attribute__((target("avx2")))
+static const char *scanFindAVX2(const char *p, size_t len, const char *needle,
+	size_t m)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+
+	while (i + m + 31 <= len)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)&p[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&p[i + m - 1]);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+		while (mask)
+		{
+			int k = __builtin_ctz(mask);
+			if (memcmp(&p[i + k], needle, m) == 0)
+				return &p[i + k];
+			mask &= mask - 1;
+		}
+		i += 32;
+	}
+	return scanFindSSE2(&p[i], len - i, needle, m);
+}
+
+#endif
+
+/* Returns the first place needle occurs in p, or NULL. */
+const char *scanFind(const char *p, size_t len, const char *needle, size_t m)
+{
+	if (m == 0 || m > len)
+		return NULL;
+	if (m == 1)
+		return memchr(p, needle[0], len);
+#ifdef SCAN_X86
+	if (__builtin_cpu_supports("avx2"))
+		return scanFindAVX2(p, len, needle, m);
+	return scanFindSSE2(p, len, needle, m);
+#else
+	return memmem(p, len, needle, m);
+#endif
+}
@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/screen.h"
+#include "../include/palette.h"
+
+/*
+ * The frame being drawn is built up as cells, and screenFlush() compares it
+ * with the frame the terminal shows, so only the cells that changed are
+ * written. Cells past the end of a line are blank, and so are trailing
+ * spaces in the plain color, which lets a shorter line be erased with one
+ * escape.
+ */
+
+#define SCREEN_MERGE_GAP 8 // unchanged cells cheaper to rewrite than to skip
+
+struct screenLine
+{
+	char *chars;
+	unsigned char *attrs;
+	int len;
+};
+
+struct screen
+{
+	int rows;
+	int cols;
+	struct screenLine *cur; // the frame being drawn
+	struct screenLine *prev; // the frame on the terminal
+	int valid; // prev is known to be on the terminal
+	int x, y; // where the terminal cursor is, x = -1 when not known
+	int attr; // the attributes the terminal draws with
+	int scroll_top; // lines [scroll_top, scroll_bottom) moved up by
+	int scroll_bottom; // scroll_n since the last frame, down if negative
+	int scroll_n;
+};
+
+static struct screen scr = { .valid = 0 };
+
+/*** frames ***/
+
+static void screenFreeLines(struct screenLine *lines)
+{
+	for (int y = 0; y < scr.rows; ++y)
+	{
+		free(lines[y].chars);
+		free(lines[y].attrs);
+	}
+	free(lines);
+}
+
+static struct screenLine *screenAllocLines()
+{
+	struct screenLine *lines = malloc(sizeof(struct screenLine) * scr.rows);
+	for (int y = 0; y < scr.rows; ++y)
+	{
+		lines[y].chars = malloc(scr.cols);
+		lines[y].attrs = malloc(scr.cols);
+		lines[y].len = 0;
+	}
+	return lines;
+}
+
+/* Starts a frame of rows lines of cols cells, all blank. */
+void screenBegin(int rows, int cols)
+{
+	if (rows != scr.rows || cols != scr.cols)
+	{
+		if (scr.cur)
+		{
+			screenFreeLines(scr.cur);
+			screenFreeLines(scr.prev);
+		}
+		scr.rows = rows;
+		scr.cols = cols;
+		scr.cur = screenAllocLines();
+		scr.prev = screenAllocLines();
+		scr.valid = 0;
+	}
+	for (int y = 0; y < scr.rows; ++y)
+		scr.cur[y].len = 0;
+	scr.scroll_n = 0;
+}
+
+void screenAppend(int y, const char *s, int len, int attr)
+{
+	struct screenLine *l = &scr.cur[y];
+	if (len > scr.cols - l->len)
+		len = scr.cols - l->len;
+	memcpy(&l->chars[l->len], s, len);
+	memset(&l->attrs[l->len], attr, len);
+	l->len += len;
+}
+
+/* Appends text drawn in the colors of its highlight classes. */
+void screenAppendHighlighted(int y, const char *s, const unsigned char *hl,
+	int len)
+{
+	struct screenLine *l = &scr.cur[y];
+	if (len > scr.cols - l->len)
+		len = scr.cols - l->len;
+	memcpy(&l->chars[l->len], s, len);
+	memcpy(&l->attrs[l->len], hl, len);
+	l->len += len;
+}
+
+/* Tells the flush that the text of lines [top, bottom) moved up by n lines,
+   or down if n is negative, so it can have the terminal move them instead of
+   writing them again. */
+void screenScroll(int top, int bottom, int n)
+{
+	scr.scroll_top = top;
+	scr.scroll_bottom = bottom;
+	scr.scroll_n = n;
+}
+
+/* Makes the next flush write every line, for when the terminal may show
+   something else. */
+void screenInvalidate()
+{
+	scr.valid = 0;
+}
+
+/*** flushing ***/
+
+static int screenCellEqual(struct screenLine *a, struct screenLine *b, int x)
+{
+	char ac = (x < a->len) ? a->chars[x] : ' ';
+	char bc = (x < b->len) ? b->chars[x] : ' ';
+	int aa = (x < a->len) ? a->attrs[x] : SCREEN_PLAIN;
+	int ba = (x < b->len) ? b->attrs[x] : SCREEN_PLAIN;
+	return ac == bc && aa == ba;
+}
+
+/* Returns the length of the line without its blank tail. */
+static int screenLineEnd(struct screenLine *l)
+{
+	int n = l->len;
+	while (n > 0 && l->chars[n - 1] == ' ' && l->attrs[n - 1] == SCREEN_PLAIN)
+		--n;
+	return n;
+}
+
+/* Multi-byte characters take fewer columns than bytes, so lines holding
+   them are always written from their start. */
+static int screenLineIsAscii(struct screenLine *l)
+{
+	for (int x = 0; x < l->len; ++x)
+		if ((unsigned char)l->chars[x] >= 0x80)
+			return 0;
+	return 1;
+}
+
+static int screenLineEqual(struct screenLine *a, struct screenLine *b)
+{
+	int end = screenLineEnd(a);
+	return end == screenLineEnd(b) && !memcmp(a->chars, b->chars, end) &&
+		!memcmp(a->attrs, b->attrs, end);
+}
+
+static void screenSetAttr(struct abuf *ab, int attr)
+{
+	if (attr == scr.attr)
+		return;
+
+	int color = attr & ~SCREEN_INVERSE;
+	if ((attr & SCREEN_INVERSE) != (scr.attr & SCREEN_INVERSE) ||
+		(color == SCREEN_PLAIN && (scr.attr & ~SCREEN_INVERSE) != SCREEN_PLAIN))
+	{
+		abAppend(ab, "\x1b[m", 3);
+		if (attr & SCREEN_INVERSE)
+			abAppend(ab, "\x1b[7m", 4);
+		scr.attr = SCREEN_PLAIN | (attr & SCREEN_INVERSE);
+	}
+	if (color != (scr.attr & ~SCREEN_INVERSE))
+		abAppend(ab, palette[color].seq, palette[color].len);
+	scr.attr = attr;
+}
+
+static void screenMoveTo(struct abuf *ab, int y, int x)
+{
+	if (y == scr.y && x == scr.x)
+		return;
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+	abAppend(ab, buf, len);
+	scr.y = y;
+	scr.x = x;
+}
+
+/* Writes cells [from, to) of line y, and erases the rest of it if erase. */
+static void screenWriteSpan(struct abuf *ab, int y, int from, int to, int erase)
+{
+	struct screenLine *l = &scr.cur[y];
+
+	screenMoveTo(ab, y, from);
+	int x = from;
+	while (x < to)
+	{
+		int run = x + 1;
+		while (run < to && l->attrs[run] == l->attrs[x])
+			++run;
+		screenSetAttr(ab, l->attrs[x]);
+		abAppend(ab, &l->chars[x], run - x);
+		x = run;
+	}
+	// the cursor stays on the last column, waiting to wrap
+	scr.x = (to < scr.cols) ? to : -1;
+
+	if (erase && to < scr.cols)
+	{
+		screenSetAttr(ab, SCREEN_PLAIN);
+		abAppend(ab, "\x1b[K", 3);
+	}
+}
+
+static void screenFlushLine(struct abuf *ab, int y)
+{
+	struct screenLine *cur = &scr.cur[y];
+	struct screenLine *prev = &scr.prev[y];
+	if (scr.valid && screenLineEqual(cur, prev))
+		return;
+
+	int end = screenLineEnd(cur);
+	if (!scr.valid || !screenLineIsAscii(cur) || !screenLineIsAscii(prev))
+	{
+		screenWriteSpan(ab, y, 0, end, 1);
+		return;
+	}
+
+	int prev_end = screenLineEnd(prev);
+	int n = (end > prev_end) ? end : prev_end;
+	int x = 0;
+	while (x < n)
+	{
+		if (screenCellEqual(cur, prev, x))
+		{
+			++x;
+			continue;
+		}
+
+		// a run of changes, taking in short gaps of unchanged cells
+		int from = x;
+		int to = x + 1;
+		for (x = to; x < n && x - to < SCREEN_MERGE_GAP; ++x)
+			if (!screenCellEqual(cur, prev, x))
+				to = x + 1;
+
+		if (to >= end && prev_end > end)
+		{
+			screenWriteSpan(ab, y, from, end > from ? end : from, 1);
+			return;
+		}
+		screenWriteSpan(ab, y, from, to, 0);
+	}
+}
+
+/* Scrolls the lines of the region on the terminal, within a scroll region
+   (DECSTBM) so the lines around it stay, if that leaves more lines of the
+   new frame already in place. */
+static void screenFlushScroll(struct abuf *ab)
+{
+	int top = scr.scroll_top;
+	int bottom = scr.scroll_bottom;
+	int n = scr.scroll_n;
+	int height = bottom - top;
+	if (n == 0 || n >= height || -n >= height)
+		return;
+
+	int kept = 0;
+	int moved = 0;
+	for (int y = top; y < bottom; ++y)
+	{
+		if (screenLineEqual(&scr.cur[y], &scr.prev[y]))
+			++kept;
+		if (y + n >= top && y + n < bottom &&
+			screenLineEqual(&scr.cur[y], &scr.prev[y + n]))
+			++moved;
+	}
+	if (moved <= kept)
+		return;
+
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dr\x1b[%d%c\x1b[r", top + 1,
+		bottom, n > 0 ? n : -n, n > 0 ? 'S' : 'T');
+	abAppend(ab, buf, len);
+	scr.x = -1;
+
+	// the lines that scrolled out come back blank at the other end
+	int count = n > 0 ? n : -n;
+	struct screenLine *out = malloc(sizeof(struct screenLine) * count);
+	if (n > 0)
+	{
+		memcpy(out, &scr.prev[top], sizeof(struct screenLine) * count);
+		memmove(&scr.prev[top], &scr.prev[top + count],
+			sizeof(struct screenLine) * (height - count));
+		memcpy(&scr.prev[bottom - count], out, sizeof(struct screenLine) * count);
+	}
+	else
+	{
+		memcpy(out, &scr.prev[bottom - count], sizeof(struct screenLine) * count);
+		memmove(&scr.prev[top + count], &scr.prev[top],
+			sizeof(struct screenLine) * (height - count));
+		memcpy(&scr.prev[top], out, sizeof(struct screenLine) * count);
+	}
+	free(out);
+	for (int y = (n > 0) ? bottom - count : top; count--; ++y)
+		scr.prev[y].len = 0;
+}
+
+/* Appends to ab what brings the terminal from the last frame to this one,
+   and leaves the cursor wherever it ends up. */
+void screenFlush(struct abuf *ab)
+{
+	scr.x = -1;
+	scr.attr = SCREEN_PLAIN;
+
+	if (scr.valid)
+		screenFlushScroll(ab);
+	for (int y = 0; y < scr.rows; ++y)
+		screenFlushLine(ab, y);
+	screenSetAttr(ab, SCREEN_PLAIN);
+
+	struct screenLine *t = scr.prev;
+	scr.prev = scr.cur;
+	scr.cur = t;
+	scr.valid = 1;
+}
@@ -0,0 +1,320 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+
+#include "../include/highlight.h"
+#include "../include/syntax.h"
+#include "../include/kwtable.h"
+#include "../obj/c_keywords.h"
+
+#ifndef SYNTAX_DIR
+#define SYNTAX_DIR "syntax"
+#endif
+
+#define SYNTAX_SEPARATORS ",.()+-/*=~%<>[];"
+
+/*
+ * Languages are described by definition files, one key per line:
+ *
+ *   name c
+ *   files .c .h            extensions, or text found in the file name
+ *   comment //            starts a comment to the end of the line
+ *   block <!-- -->        a comment that may span rows
+ *   blockstring """ """   a string that may span rows
+ *   strings " '
+ *   numbers
+ *   separators ,.()       end words, besides white space
+ *   keywords if else ...
+ *   types int char ...
+ *
+ * They are read from $KILO_SYNTAX_DIR, ~/.kilo/syntax and SYNTAX_DIR, and the
+ * first definition of a name wins. C is also built in, for when none of them
+ * is installed.
+ */
+
+static char *C_HL_extensions[] = { ".c", ".h", ".cpp", NULL };
+
+static struct editorSyntax builtin_c =
+{
+	.filetype = "c",
+	.filematch = C_HL_extensions,
+	.keywords = &c_keywords,
+	.singleline_comment_start = "//",
+	.blocks = { { "/*", "*/", 2, 2, HL_MLCOMMENT } },
+	.nblocks = 1,
+	.quotes = "\"'",
+	.flags = HL_HIGHLIGHT_NUMBERS
+};
+
+static struct editorSyntax **syntaxes = NULL;
+static int nsyntaxes = 0;
+
+/*** compiling ***/
+
+/* Fills in the class of every byte, so the lexer can step over runs of
+   plain text with one table lookup a byte. */
+static void editorCompileSyntax(struct editorSyntax *s)
+{
+	unsigned char *cls = s->cls;
+	memset(cls, 0, sizeof(s->cls));
+
+	cls[0] = LX_SEP;
+	for (int c = 1; c < 256; ++c)
+		if (isspace(c))
+			cls[c] |= LX_SEP;
+	for (const char *p = s->separators ? s->separators : SYNTAX_SEPARATORS; *p; ++p)
+		cls[(unsigned char)*p] |= LX_SEP;
+
+	if (s->flags & HL_HIGHLIGHT_NUMBERS)
+	{
+		for (int c = '0'; c <= '9'; ++c)
+			cls[c] |= LX_DIGIT | LX_NUM;
+		cls['.'] |= LX_NUM;
+	}
+
+	if (s->singleline_comment_start)
+		cls[(unsigned char)s->singleline_comment_start[0]] |= LX_START;
+	for (int i = 0; i < s->nblocks; ++i)
+		cls[(unsigned char)s->blocks[i].start[0]] |= LX_START;
+	for (const char *p = s->quotes ? s->quotes : ""; *p; ++p)
+		cls[(unsigned char)*p] |= LX_START | LX_QUOTE;
+
+	s->kwstart = 0;
+	const struct kwtable *kw = s->keywords;
+	for (unsigned int i = 0; i <= kw->mask; ++i)
+	{
+		const struct kwentry *e = &kw->slots[i];
+		for (int j = 0; e->word && j < e->len; ++j)
+			if (cls[(unsigned char)e->word[j]] & LX_START)
+				s->kwstart = 1;
+	}
+}
+
+/*** loading ***/
+
+static void editorFreeSyntax(struct editorSyntax *s)
+{
+	free(s->filetype);
+	for (int i = 0; s->filematch && s->filematch[i]; ++i)
+		free(s->filematch[i]);
+	free(s->filematch);
+	free(s->singleline_comment_start);
+	for (int i = 0; i < s->nblocks; ++i)
+	{
+		free(s->blocks[i].start);
+		free(s->blocks[i].end);
+	}
+	free(s->quotes);
+	free(s->separators);
+	if (s->keywords)
+	{
+		const struct kwtable *kw = s->keywords;
+		for (unsigned int i = 0; i <= kw->mask; ++i)
+			free((char *)kw->slots[i].word);
+		free((struct kwentry *)kw->slots);
+		free((struct kwtable *)kw);
+	}
+	free(s);
+}
+
+static char *editorNextWord(char **save)
+{
+	return strtok_r(NULL, " \t\r\n", save);
+}
+
+/* Reads one definition, returns NULL if it has no name or no files, or its
+   keywords do not fit in a table. */
+static struct editorSyntax *editorParseSyntax(FILE *fp)
+{
+	struct editorSyntax *s = calloc(1, sizeof(struct editorSyntax));
+	struct kwentry *words = NULL;
+	int nwords = 0;
+	int nfiles = 0;
+
+	char *line = NULL;
+	size_t cap = 0;
+	while (getline(&line, &cap, fp) != -1)
+	{
+		char *save;
+		char *key = strtok_r(line, " \t\r\n", &save);
+		if (key == NULL || key[0] == '#')
+			continue;
+
+		char *w;
+		if (!strcmp(key, "name") && (w = editorNextWord(&save)))
+		{
+			free(s->filetype);
+			s->filetype = strdup(w);
+		}
+		else if (!strcmp(key, "files"))
+		{
+			while ((w = editorNextWord(&save)))
+			{
+				s->filematch = realloc(s->filematch, sizeof(char *) * (nfiles + 2));
+				s->filematch[nfiles++] = strdup(w);
+				s->filematch[nfiles] = NULL;
+			}
+		}
+		else if (!strcmp(key, "comment") && (w = editorNextWord(&save)))
+		{
+			free(s->singleline_comment_start);
+			s->singleline_comment_start = strdup(w);
+		}
+		else if ((!strcmp(key, "block") || !strcmp(key, "blockstring")) &&
+			s->nblocks < HL_MAX_BLOCKS)
+		{
+			char *start = editorNextWord(&save);
+			char *end = editorNextWord(&save);
+			if (start == NULL || end == NULL)
+				continue;
+			struct editorBlock *b = &s->blocks[s->nblocks++];
+			b->start = strdup(start);
+			b->end = strdup(end);
+			b->slen = strlen(start);
+			b->elen = strlen(end);
+			b->hl = !strcmp(key, "block") ? HL_MLCOMMENT : HL_STRING;
+		}
+		else if (!strcmp(key, "strings"))
+		{
+			while ((w = editorNextWord(&save)))
+			{
+				int len = s->quotes ? strlen(s->quotes) : 0;
+				s->quotes = realloc(s->quotes, len + strlen(w) + 1);
+				strcpy(&s->quotes[len], w);
+			}
+		}
+		else if (!strcmp(key, "numbers"))
+		{
+			s->flags |= HL_HIGHLIGHT_NUMBERS;
+		}
+		else if (!strcmp(key, "separators") && (w = editorNextWord(&save)))
+		{
+			free(s->separators);
+			s->separators = strdup(w);
+		}
+		else if (!strcmp(key, "keywords") || !strcmp(key, "types"))
+		{
+			int hl = !strcmp(key, "types") ? HL_KEYWORD2 : HL_KEYWORD1;
+			while ((w = editorNextWord(&save)))
+			{
+				if (kwListed(words, nwords, w, strlen(w)))
+					continue; // the first listing counts
+				words = realloc(words, sizeof(struct kwentry) * (nwords + 1));
+				words[nwords].word = strdup(w);
+				words[nwords].len = strlen(w);
+				words[nwords].hl = hl;
+				++nwords;
+			}
+		}
+	}
+	free(line);
+
+	struct kwtable *kw = malloc(sizeof(struct kwtable));
+	if (kwBuild(kw, words, nwords) == -1)
+	{
+		for (int i = 0; i < nwords; ++i)
+			free((char *)words[i].word);
+		free(kw);
+		kw = NULL;
+	}
+	s->keywords = kw;
+	free(words);
+
+	if (s->filetype == NULL || s->filematch == NULL || s->keywords == NULL)
+	{
+		editorFreeSyntax(s);
+		return NULL;
+	}
+	editorCompileSyntax(s);
+	return s;
+}
+
+static void editorAddSyntax(struct editorSyntax *s)
+{
+	for (int i = 0; i < nsyntaxes; ++i)
+	{
+		if (!strcmp(syntaxes[i]->filetype, s->filetype))
+		{
+			if (s != &builtin_c)
+				editorFreeSyntax(s);
+			return;
+		}
+	}
+	syntaxes = realloc(syntaxes, sizeof(struct editorSyntax *) * (nsyntaxes + 1));
+	syntaxes[nsyntaxes++] = s;
+}
+
+static void editorLoadSyntaxDir(const char *dir)
+{
+	DIR *d = opendir(dir);
+	if (d == NULL)
+		return;
+
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL)
+	{
+		size_t len = strlen(ent->d_name);
+		if (len <= 7 || strcmp(&ent->d_name[len - 7], ".syntax"))
+			continue;
+
+		char *path = malloc(strlen(dir) + len + 2);
+		sprintf(path, "%s/%s", dir, ent->d_name);
+		FILE *fp = fopen(path, "r");
+		free(path);
+		if (fp == NULL)
+			continue;
+
+		struct editorSyntax *s = editorParseSyntax(fp);
+		fclose(fp);
+		if (s)
+			editorAddSyntax(s);
+	}
+	closedir(d);
+}
+
+void editorLoadSyntaxes()
+{
+	char *dir = getenv("KILO_SYNTAX_DIR");
+	if (dir)
+		editorLoadSyntaxDir(dir);
+
+	char *home = getenv("HOME");
+	if (home)
+	{
+		char *path = malloc(strlen(home) + sizeof("/.kilo/syntax"));
+		sprintf(path, "%s/.kilo/syntax", home);
+		editorLoadSyntaxDir(path);
+		free(path);
+	}
+
+	editorLoadSyntaxDir(SYNTAX_DIR);
+
+	editorCompileSyntax(&builtin_c);
+	editorAddSyntax(&builtin_c);
+}
+
+/*** lookup ***/
+
+struct editorSyntax *editorFindSyntax(const char *filename)
+{
+	char *ext = strrchr(filename, '.');
+
+	for (int j = 0; j < nsyntaxes; ++j)
+	{
+		struct editorSyntax *s = syntaxes[j];
+		for (int i = 0; s->filematch[i]; ++i)
+		{
+			int is_ext = (s->filematch[i][0] == '.');
+			if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+				(!is_ext && strstr(filename, s->filematch[i])))
+			{
+				return s;
+			}
+		}
+	}
+	return NULL;
+}
@@ -1,15 +1,45 @@
+#define _GNU_SOURCE
+
 #include <termios.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <stdio.h>
 
 #include "../include/editor.h"
+#include "../include/output.h"
+
+#define KILO_BUSY_MS 100 // how often progress is drawn while a background job runs
+#define KILO_ESC_MS 100 // how long the rest of an escape sequence is waited for
+#define KILO_PASTE_MS 1000 // how long a paste may stall before what came is taken
+#define KILO_INBUF (64 * 1024) // a power of two
+#define KILO_MAX_PARAMS 4
+#define KILO_MAX_SEQ 32 // longer ones are not escape sequences
 
 extern struct editorConfig E;
 
 int getWindowSize(int *rows, int *cols);
 
+// SIGWINCH writes a byte here, so a resize wakes up the poll for input
+static int winch_pipe[2] = { -1, -1 };
+
+// clicks and the wheel are only reported when KILO_MOUSE is set, since
+// tracking them takes selecting text with the mouse away from the terminal
+static int mouse = 0;
+
+static struct
+{
+	unsigned char buf[KILO_INBUF];
+	unsigned int head; // next byte to decode, counted since the start
+	unsigned int tail; // end of what has been read
+} in;
+
 /*** terminal ***/
 
 void die(const char *s)
@@ -22,8 +52,46 @@ void die(const char *s)
 	exit(1);
 }
 
+static void editorHandleWinch(int sig)
+{
+	(void)sig;
+	int saved = errno;
+	write(winch_pipe[1], "", 1);
+	errno = saved;
+}
+
+static void editorWatchResize()
+{
+	if (pipe2(winch_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+		die("pipe");
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = editorHandleWinch;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGWINCH, &sa, NULL) == -1)
+		die("sigaction");
+}
+
+/* Takes in the window size, returns whether it changed. */
+static int editorUpdateWindowSize()
+{
+	if (getWindowSize(&E.screenrows, &E.screencols) == -1)
+		die("getWindowSize");
+	E.screenrows -= 2;
+	if (E.prev_screenrows == E.screenrows && E.prev_screencols == E.screencols)
+		return 0;
+	E.prev_screenrows = E.screenrows;
+	E.prev_screencols = E.screencols;
+	return 1;
+}
+
 void disableRawMode()
 {
+	if (mouse)
+		write(STDOUT_FILENO, "\x1b[?1006l\x1b[?1000l", 16);
+	write(STDOUT_FILENO, "\x1b[?2004l", 8);
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
 		die("tcsetattr");
 }
@@ -40,92 +108,364 @@ void enableRawMode()
 	raw.c_cflag |= (CS8);
 	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 	raw.c_cc[VMIN] = 0;
-	raw.c_cc[VTIME] = 1;
+	raw.c_cc[VTIME] = 0; // input is waited for with poll()
 
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
 		die("tcsetattr");
+
+	// pasted text is sent between ESC [ 200 ~ and ESC [ 201 ~, and clicks
+	// and the wheel as ESC [ < b ; x ; y M
+	write(STDOUT_FILENO, "\x1b[?2004h", 8);
+	char *m = getenv("KILO_MOUSE");
+	mouse = (m && atoi(m) > 0);
+	if (mouse)
+		write(STDOUT_FILENO, "\x1b[?1000h\x1b[?1006h", 16);
+
+	editorWatchResize();
 }
 
-int editorReadKey()
+/*** input ***/
+
+/*
+ * Input is read into a ring buffer in chunks as large as the terminal has
+ * ready, and keys are decoded from there. An escape sequence that is cut
+ * short waits up to KILO_ESC_MS for the rest before its ESC is taken as the
+ * ESC key.
+ */
+
+static int editorInputLen()
+{
+	return in.tail - in.head;
+}
+
+static unsigned char editorInputPeek(int i)
+{
+	return in.buf[(in.head + i) & (KILO_INBUF - 1)];
+}
+
+/* Reads what the terminal has, waiting up to timeout milliseconds (-1 for
+   ever) for something to come. Returns the number of bytes read. */
+static int editorFillInput(int timeout)
+{
+	unsigned int space = KILO_INBUF - editorInputLen();
+	if (space == 0)
+		return 0;
+
+	if (timeout != 0)
+	{
+		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+		if (poll(&pfd, 1, timeout) <= 0)
+			return 0;
+	}
+
+	unsigned int at = in.tail & (KILO_INBUF - 1);
+	unsigned int first = (space < KILO_INBUF - at) ? space : KILO_INBUF - at;
+	struct iovec iov[] =
+	{
+		{ &in.buf[at], first },
+		{ in.buf, space - first }
+	};
+
+	ssize_t n = readv(STDIN_FILENO, iov, space > first ? 2 : 1);
+	if (n == -1 && errno != EAGAIN && errno != EINTR)
+		die("read");
+	if (n <= 0)
+		return 0;
+	in.tail += n;
+	return n;
+}
+
+/* Sleeps until there is input. Returns 0 instead when the screen has to be
+   drawn first: the window was resized, the status message ran out, or a
+   background job has progress to show. Nothing else wakes an idle editor. */
+static int editorWaitInput()
 {
-	int nread;
-	char c;
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
+	if (editorInputLen() > 0)
+		return 1;
+
+	while (1)
 	{
-		if (nread == -1 && errno != EAGAIN)
-			die("read");
-		if (getWindowSize(&E.screenrows, &E.screencols) == -1)
-			die("getWindowSize");
-		E.screenrows -= 2;
-		if (E.prev_screenrows != E.screenrows ||
-			E.prev_screencols != E.screencols)
+		int timeout = (E.loading || E.highlighting || E.searching || E.saving) ? KILO_BUSY_MS :
+			editorStatusTimeout();
+		struct pollfd fds[2] =
 		{
-			E.prev_screenrows = E.screenrows;
-			E.prev_screencols = E.screencols;
-			c = -1;
-			break;
+			{ .fd = STDIN_FILENO, .events = POLLIN },
+			{ .fd = winch_pipe[0], .events = POLLIN }
+		};
+
+		int n = poll(fds, 2, timeout);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			die("poll");
+		if (n == 0)
+			return 0;
+
+		if (fds[1].revents & POLLIN)
+		{
+			char buf[64];
+			while (read(winch_pipe[0], buf, sizeof(buf)) > 0)
+				;
+			if (editorUpdateWindowSize())
+				return 0;
 		}
+		if (fds[0].revents)
+			return 1;
 	}
+}
+
+/* xterm sends the modifiers of a key as 1 + shift + 2 alt + 4 ctrl. */
+static int editorModifiers(int param)
+{
+	int m = (param > 1) ? param - 1 : 0;
+	return ((m & 1) ? KEY_SHIFT : 0) | ((m & 2) ? KEY_ALT : 0) |
+		((m & 4) ? KEY_CTRL : 0);
+}
+
+/* The key of ESC O final, or ESC [ 1 ; m final. */
+static int editorFinalKey(int final)
+{
+	switch (final)
+	{
+	case 'A': return ARROW_UP;
+	case 'B': return ARROW_DOWN;
+	case 'C': return ARROW_RIGHT;
+	case 'D': return ARROW_LEFT;
+	case 'H': return HOME_KEY;
+	case 'F': return END_KEY;
+	case 'P': return F1_KEY;
+	case 'Q': return F1_KEY + 1;
+	case 'R': return F1_KEY + 2;
+	case 'S': return F1_KEY + 3;
+	}
+	return -1;
+}
 
-	if (c == '\x1b')
+/* The key of ESC [ n ~. */
+static int editorTildeKey(int n)
+{
+	switch (n)
 	{
-		char seq[3];
+	case 1: case 7: return HOME_KEY;
+	case 3: return DEL_KEY;
+	case 4: case 8: return END_KEY;
+	case 5: return PAGE_UP;
+	case 6: return PAGE_DOWN;
+	case 200: return PASTE_START;
+	}
+	if (n >= 11 && n <= 15)
+		return F1_KEY + n - 11;
+	if (n >= 17 && n <= 21)
+		return F1_KEY + n - 12;
+	if (n == 23 || n == 24)
+		return F1_KEY + n - 13;
+	return -1;
+}
 
-		if (read(STDIN_FILENO, &seq[0], 1) != 1)
-			return '\x1b';
-		if (read(STDIN_FILENO, &seq[1], 1) != 1)
-			return '\x1b';
+static int editorMouseKey(int b, int x, int y, int pressed)
+{
+	E.mouse.button = b & ~(4 | 8 | 16 | 32);
+	E.mouse.x = x - 1;
+	E.mouse.y = y - 1;
+	E.mouse.pressed = pressed;
+	if (b & 32)
+		return -1; // motion, which is not asked for
+	return MOUSE_EVENT | ((b & 4) ? KEY_SHIFT : 0) | ((b & 8) ? KEY_ALT : 0) |
+		((b & 16) ? KEY_CTRL : 0);
+}
 
-		if (seq[0] == '[')
+/* Decodes the key at the head of the input into *key. Returns the number of
+   bytes it takes, or 0 when the input ends inside an escape sequence. */
+static int editorDecodeKey(int *key)
+{
+	enum { KS_ESC, KS_CSI, KS_SS3 } state = KS_ESC;
+	int params[KILO_MAX_PARAMS] = { 0 };
+	int nparams = 0;
+	int private = 0;
+	int len = editorInputLen();
+
+	if (len == 0)
+		return 0;
+	if (editorInputPeek(0) != '\x1b')
+	{
+		*key = editorInputPeek(0);
+		return 1;
+	}
+
+	for (int i = 1; i < len; ++i)
+	{
+		unsigned char c = editorInputPeek(i);
+		if (i > KILO_MAX_SEQ)
 		{
-			if (seq[1] >= '0' && seq[1] <= '9')
+			// not a sequence after all
+			*key = '\x1b';
+			return 1;
+		}
+
+		switch (state)
+		{
+		case KS_ESC:
+			if (c == '[')
 			{
-				if (read(STDIN_FILENO, &seq[2], 1) != 1)
-					return '\x1b';
-				if (seq[2] == '~')
-				{
-					switch (seq[1])
-					{
-					case '1': return HOME_KEY;
-					case '3': return DEL_KEY;
-					case '4': return END_KEY;
-					case '5': return PAGE_UP;
-					case '6': return PAGE_DOWN;
-					case '7': return HOME_KEY;
-					case '8': return END_KEY;
-					}
-				}
+				state = KS_CSI;
+				continue;
 			}
-			else
+			if (c == 'O')
 			{
-				switch (seq[1])
-				{
-				case 'A': return ARROW_UP;
-				case 'B': return ARROW_DOWN;
-				case 'C': return ARROW_RIGHT;
-				case 'D': return ARROW_LEFT;
-				case 'H': return HOME_KEY;
-				case 'F': return END_KEY;
-				}
+				state = KS_SS3;
+				continue;
 			}
-		}
-		else if (seq[0] == 'O')
-		{
-			switch (seq[1])
+			if (c == '\x1b')
 			{
-			case 'H': return HOME_KEY;
-			case 'F': return END_KEY;
+				*key = '\x1b';
+				return 1;
 			}
+			*key = KEY_ALT | c;
+			return 2;
+
+		case KS_SS3:
+			*key = editorFinalKey(c);
+			return 3;
+
+		case KS_CSI:
+			if (c >= '0' && c <= '9')
+			{
+				params[nparams] = params[nparams] * 10 + (c - '0');
+				if (params[nparams] > 9999)
+					params[nparams] = 9999;
+				continue;
+			}
+			if (c == ';')
+			{
+				if (nparams < KILO_MAX_PARAMS - 1)
+					++nparams;
+				continue;
+			}
+			if (c >= '<' && c <= '?' && i == 2)
+			{
+				private = c;
+				continue;
+			}
+			if (c < 0x40 || c > 0x7e)
+			{
+				*key = '\x1b';
+				return 1;
+			}
+
+			++nparams;
+			if (private == '<' && (c == 'M' || c == 'm') && nparams == 3)
+			{
+				*key = editorMouseKey(params[0], params[1], params[2], c == 'M');
+				return i + 1;
+			}
+			if (private == 0 && c == 'M' && i == 2)
+			{
+				// the old mouse encoding, three bytes offset by 32
+				if (len < 6)
+					return 0;
+				int b = editorInputPeek(3) - 32;
+				*key = editorMouseKey(b, editorInputPeek(4) - 32,
+					editorInputPeek(5) - 32, (b & 3) != 3);
+				if ((b & 3) == 3)
+					E.mouse.button = 0;
+				return 6;
+			}
+			if (private)
+				*key = -1;
+			else if (c == '~')
+				*key = editorTildeKey(params[0]);
+			else if (c == 'Z')
+				*key = KEY_SHIFT | '\t';
+			else
+				*key = editorFinalKey(c);
+			if (*key != -1 && nparams > 1)
+				*key |= editorModifiers(params[1]);
+			return i + 1;
 		}
+	}
+	return 0;
+}
 
-		return '\x1b';
+/* Returns the next key, or -1 when there is none to handle: the screen only
+   needs a redraw, or the sequence read is one the editor has no use for. */
+int editorReadKey()
+{
+	if (editorInputLen() == 0)
+	{
+		if (!editorWaitInput())
+			return -1; // only a redraw was asked for
+		editorFillInput(0);
 	}
-	else
+
+	int key;
+	int n;
+	while ((n = editorDecodeKey(&key)) == 0)
+	{
+		if (editorInputLen() == 0)
+			return -1;
+		if (editorFillInput(KILO_ESC_MS) == 0)
+		{
+			key = '\x1b'; // the rest never came, so it was the ESC key
+			n = 1;
+			break;
+		}
+	}
+	in.head += n;
+	return key;
+}
+
+/* Reads the text of a paste up to the ESC [ 201 ~ that ends it, or up to
+   where input stopped for KILO_PASTE_MS. Returns it in a malloc'd buffer. */
+char *editorReadPaste(int *len)
+{
+	static const char end[] = "\x1b[201~";
+	int elen = sizeof(end) - 1;
+	int cap = 4096;
+	char *buf = malloc(cap);
+	int n = 0;
+
+	while (1)
 	{
-		return c;
+		int avail = editorInputLen();
+		if (n + avail > cap)
+		{
+			cap = (n + avail > cap * 2) ? n + avail : cap * 2;
+			buf = realloc(buf, cap);
+		}
+		unsigned int at = in.head & (KILO_INBUF - 1);
+		int first = (avail < (int)(KILO_INBUF - at)) ? avail : (int)(KILO_INBUF - at);
+		memcpy(&buf[n], &in.buf[at], first);
+		memcpy(&buf[n + first], in.buf, avail - first);
+		in.head += avail;
+
+		int from = (n > elen - 1) ? n - (elen - 1) : 0;
+		n += avail;
+		char *e = memmem(&buf[from], n - from, end, elen);
+		if (e)
+		{
+			// what followed the paste is still in the ring, give it back
+			in.head -= &buf[n] - (e + elen);
+			*len = e - buf;
+			return buf;
+		}
+		if (editorFillInput(KILO_PASTE_MS) == 0)
+		{
+			// the terminal went away or the end of the paste was lost
+			*len = n;
+			return buf;
+		}
 	}
 }
 
+/* Waits up to timeout milliseconds for input, returns whether some came. */
+int editorInputPending(int timeout)
+{
+	if (editorInputLen() > 0)
+		return 1;
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	return poll(&pfd, 1, timeout) > 0;
+}
+
 int getCursorPosition(int *rows, int *cols)
 {
 	char buf[32];
@@ -136,8 +476,10 @@ int getCursorPosition(int *rows, int *cols)
 
 	while (i < sizeof(buf) - 1)
 	{
-		if (read(STDIN_FILENO, &buf[i], 1) != 1)
+		if (editorInputLen() == 0 && editorFillInput(KILO_ESC_MS) == 0)
 			break;
+		buf[i] = editorInputPeek(0);
+		in.head++;
 		if (buf[i] == 'R')
 			break;
 		++i;
@@ -160,7 +502,6 @@ int getWindowSize(int *rows, int *cols)
 	{
 		if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
 			return -1;
-		editorReadKey();
 		return getCursorPosition(rows, cols);
 	}
 	else
@@ -0,0 +1,454 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/undo.h"
+#include "../include/editor.h"
+#include "../include/row.h"
+#include "../include/ptable.h"
+#include "../include/output.h"
+
+#define KILO_UNDO_MB 64 // journal size when $KILO_UNDO_MB is not set
+#define KILO_UNDO_TEXT_MIN 4096 // bytes of journal text allocated at first
+
+extern struct editorConfig E;
+
+/*
+ * Edits are journaled as the primitive row operations they are made of,
+ * never as copies of rows. A record holds where the operation happened and
+ * the text it inserted or removed; the text of all records is kept in one
+ * append-only buffer. Every key starts a new group (editorUndoMark), and
+ * undo and redo work on whole groups, so an Enter or a paste is undone at
+ * once. Typing and deleting one character at a time extend the record of
+ * the previous key instead of adding one each.
+ *
+ * Records past 'cur' have been undone and can be redone, until the next
+ * edit drops them. When the journal outgrows its limit, the oldest groups
+ * are dropped.
+ */
+
+enum journalOp
+{
+	J_INSERT, // text inserted into row at col
+	J_DELETE, // text removed from row at col
+	J_INSROWS, // n rows inserted at row, text holds them separated by newlines
+	J_DELROWS, // n rows removed at row
+	J_REPLACE, // n edits made at once, see editorJournalReplace()
+	J_RESTORE // the same edits taken back
+};
+
+struct jrecord
+{
+	int op;
+	int group;
+	int typed; // made one character at a time, so more may be merged in
+	int row;
+	int col;
+	int n;
+	size_t off; // of the text in the journal
+	size_t len;
+	int cx, cy; // the cursor before the group
+	int acx, acy; // and after it
+};
+
+static struct
+{
+	struct jrecord *recs;
+	int nrecs;
+	int cap;
+	int cur; // records in front of this one are applied
+	char *text;
+	size_t textlen;
+	size_t textcap;
+	size_t limit;
+	int group;
+	int open; // the last record's group has not been given its cursor yet
+	int dropped; // group whose records no longer fit, so none are kept
+	int replaying;
+	int markcx, markcy;
+} J = { .group = 1, .dropped = -1 };
+
+/*** journal ***/
+
+static size_t editorJournalSize()
+{
+	return J.textlen + sizeof(struct jrecord) * J.nrecs;
+}
+
+static void editorJournalClear()
+{
+	J.nrecs = J.cur = 0;
+	J.textlen = 0;
+	J.open = 0;
+}
+
+/* Drops the oldest groups until 'need' more bytes fit in three quarters of
+   the limit, so that this does not happen on every edit. The group being
+   recorded is kept. */
+static void editorJournalTrim(size_t need)
+{
+	int drop = 0;
+	size_t size = editorJournalSize() + need;
+	while (drop < J.nrecs && size > J.limit / 4 * 3 && J.recs[drop].group != J.group)
+	{
+		int group = J.recs[drop].group;
+		while (drop < J.nrecs && J.recs[drop].group == group)
+		{
+			size -= J.recs[drop].len + sizeof(struct jrecord);
+			++drop;
+		}
+	}
+
+	if (drop == J.nrecs)
+	{
+		editorJournalClear();
+		return;
+	}
+
+	size_t off = J.recs[drop].off;
+	memmove(J.text, &J.text[off], J.textlen - off);
+	J.textlen -= off;
+	memmove(J.recs, &J.recs[drop], sizeof(struct jrecord) * (J.nrecs - drop));
+	J.nrecs -= drop;
+	J.cur -= drop;
+	for (int i = 0; i < J.nrecs; ++i)
+		J.recs[i].off -= off;
+}
+
+static void editorJournalReserve(size_t len)
+{
+	// allocated even for an empty first record, whose text is still copied
+	if (J.text && J.textlen + len <= J.textcap)
+		return;
+	J.textcap = (J.textlen + len > J.textcap * 2) ? J.textlen + len : J.textcap * 2;
+	if (J.textcap < KILO_UNDO_TEXT_MIN)
+		J.textcap = KILO_UNDO_TEXT_MIN;
+	J.text = realloc(J.text, J.textcap);
+}
+
+/* Starts a record of the current group and returns it, or NULL when the
+   journal is being replayed or the group did not fit. */
+static struct jrecord *editorJournalAdd(int op, int row, size_t len)
+{
+	if (J.replaying || J.group == J.dropped)
+		return NULL;
+
+	if (J.limit == 0)
+	{
+		char *mb = getenv("KILO_UNDO_MB");
+		J.limit = (size_t)((mb && atoi(mb) > 0) ? atoi(mb) : KILO_UNDO_MB) << 20;
+	}
+
+	// an edit after an undo drops what could have been redone
+	if (J.cur < J.nrecs)
+	{
+		J.textlen = J.recs[J.cur].off;
+		J.nrecs = J.cur;
+	}
+
+	size_t need = len + sizeof(struct jrecord);
+	if (editorJournalSize() + need > J.limit)
+		editorJournalTrim(need);
+	if (editorJournalSize() + need > J.limit)
+	{
+		// the rest of the group is not kept either, and neither is
+		// anything before it, which could no longer be undone in order
+		editorJournalClear();
+		J.dropped = J.group;
+		return NULL;
+	}
+
+	if (J.nrecs == J.cap)
+	{
+		J.cap = J.cap ? J.cap * 2 : 64;
+		J.recs = realloc(J.recs, sizeof(struct jrecord) * J.cap);
+	}
+	editorJournalReserve(len);
+
+	struct jrecord *r = &J.recs[J.nrecs];
+	int first = (J.nrecs == 0 || J.recs[J.nrecs - 1].group != J.group);
+	r->op = op;
+	r->group = J.group;
+	r->typed = 0;
+	r->row = row;
+	r->col = 0;
+	r->n = 1;
+	r->off = J.textlen;
+	r->len = len;
+	r->cx = first ? J.markcx : J.recs[J.nrecs - 1].cx;
+	r->cy = first ? J.markcy : J.recs[J.nrecs - 1].cy;
+	J.textlen += len;
+	J.cur = ++J.nrecs;
+	J.open = 1;
+	return r;
+}
+
+/* Returns the last record when the character typed at row, col continues
+   it: it has to be a typed record of the same kind that is a group of its
+   own, and col has to be where the next character of the run goes. */
+static struct jrecord *editorJournalRun(int op, int row, int col)
+{
+	if (J.replaying || J.nrecs == 0 || J.cur < J.nrecs)
+		return NULL;
+
+	struct jrecord *r = &J.recs[J.nrecs - 1];
+	if (!r->typed || r->op != op || r->row != row)
+		return NULL;
+	if (J.nrecs > 1 && J.recs[J.nrecs - 2].group == r->group)
+		return NULL;
+	if (editorJournalSize() >= J.limit)
+		return NULL;
+
+	if (op == J_INSERT && col == r->col + (int)r->len)
+		return r;
+	if (op == J_DELETE && (col == r->col || col == r->col - 1))
+		return r;
+	return NULL;
+}
+
+/*** recording ***/
+
+/* Starts a new group; called for every key before it is handled. */
+void editorUndoMark()
+{
+	if (J.open)
+	{
+		J.recs[J.nrecs - 1].acx = E.cx;
+		J.recs[J.nrecs - 1].acy = E.cy;
+		J.open = 0;
+	}
+	++J.group;
+	J.markcx = E.cx;
+	J.markcy = E.cy;
+}
+
+void editorJournalInsert(int at, int col, const char *s, int len, int typed)
+{
+	struct jrecord *r;
+	if (typed && len == 1 && (r = editorJournalRun(J_INSERT, at, col)))
+	{
+		editorJournalReserve(1);
+		J.text[J.textlen++] = s[0];
+		r->len++;
+		r->group = J.group;
+		J.open = 1;
+		return;
+	}
+
+	if ((r = editorJournalAdd(J_INSERT, at, len)) == NULL)
+		return;
+	r->typed = typed;
+	r->col = col;
+	memcpy(&J.text[r->off], s, len);
+}
+
+void editorJournalDelete(int at, int col, const char *s, int len, int typed)
+{
+	struct jrecord *r;
+	if (typed && len == 1 && (r = editorJournalRun(J_DELETE, at, col)))
+	{
+		editorJournalReserve(1);
+		if (col == r->col)
+		{
+			J.text[J.textlen] = s[0]; // DEL, the run grows to the right
+		}
+		else
+		{
+			// backspace, the character goes in front of the run
+			memmove(&J.text[r->off + 1], &J.text[r->off], r->len);
+			J.text[r->off] = s[0];
+			r->col = col;
+		}
+		J.textlen++;
+		r->len++;
+		r->group = J.group;
+		J.open = 1;
+		return;
+	}
+
+	if ((r = editorJournalAdd(J_DELETE, at, len)) == NULL)
+		return;
+	r->typed = typed;
+	r->col = col;
+	memcpy(&J.text[r->off], s, len);
+}
+
+void editorJournalInsertRows(int at, const char *s, size_t len, int n)
+{
+	struct jrecord *r = editorJournalAdd(J_INSROWS, at, len);
+	if (r == NULL)
+		return;
+	r->n = n;
+	memcpy(&J.text[r->off], s, len);
+}
+
+/* Records the n rows from 'at' on, which are about to be removed. */
+void editorJournalDeleteRows(int at, int n)
+{
+	if (J.replaying || J.group == J.dropped)
+		return;
+
+	size_t len = n - 1;
+	ptiter it;
+	ptIterInit(&it, at);
+	for (int i = 0; i < n; ++i)
+	{
+		erow *row;
+		char *s;
+		int rlen;
+		ptIterNext(&it, &row, &s, &rlen);
+		len += row ? row->size : rlen;
+	}
+
+	struct jrecord *r = editorJournalAdd(J_DELROWS, at, len);
+	if (r == NULL)
+		return;
+	r->n = n;
+
+	char *p = &J.text[r->off];
+	ptIterInit(&it, at);
+	for (int i = 0; i < n; ++i)
+	{
+		erow *row;
+		char *s;
+		int rlen;
+		ptIterNext(&it, &row, &s, &rlen);
+		if (row)
+		{
+			rlen = row->size;
+			s = editorRowCharsFrom(row, 0);
+		}
+		memcpy(p, s, rlen);
+		p += rlen;
+		if (i + 1 < n)
+			*p++ = '\n';
+	}
+}
+
+/* Records edits about to be made by editorRowsReplace(). The text holds,
+   for each edit, its row, col, the length of the text it replaces and of
+   the text it puts there, followed by both texts. */
+void editorJournalReplace(const struct rowEdit *edits, int n)
+{
+	if (J.replaying || J.group == J.dropped)
+		return;
+
+	size_t len = 0;
+	for (int i = 0; i < n; ++i)
+		len += sizeof(int) * 4 + edits[i].len + edits[i].slen;
+
+	struct jrecord *r = editorJournalAdd(J_REPLACE, edits[0].row, len);
+	if (r == NULL)
+		return;
+	r->n = n;
+
+	char *p = &J.text[r->off];
+	for (int i = 0; i < n; ++i)
+	{
+		const struct rowEdit *e = &edits[i];
+		int head[4] = { e->row, e->col, e->len, e->slen };
+		memcpy(p, head, sizeof(head));
+		p += sizeof(head);
+		memcpy(p, editorRowCharsFrom(ptRow(e->row), e->col), e->len);
+		p += e->len;
+		memcpy(p, e->s, e->slen);
+		p += e->slen;
+	}
+}
+
+/*** undo ***/
+
+/* Makes the edits of a J_REPLACE record again, or takes them back. Taking
+   them back replaces the new texts with the old ones, which are further
+   along the row by what the edits in front of them added. */
+static void editorJournalReplay(struct jrecord *r, int restore)
+{
+	struct rowEdit *edits = malloc(sizeof(struct rowEdit) * r->n);
+	char *p = &J.text[r->off];
+	int shift = 0;
+
+	for (int i = 0; i < r->n; ++i)
+	{
+		int head[4];
+		memcpy(head, p, sizeof(head));
+		p += sizeof(head);
+		char *old = p;
+		char *new = p + head[2];
+		p = new + head[3];
+
+		if (i > 0 && head[0] != edits[i - 1].row)
+			shift = 0;
+		edits[i].row = head[0];
+		edits[i].col = head[1] + (restore ? shift : 0);
+		edits[i].len = restore ? head[3] : head[2];
+		edits[i].s = restore ? old : new;
+		edits[i].slen = restore ? head[2] : head[3];
+		shift += head[3] - head[2];
+	}
+
+	editorRowsReplace(edits, r->n);
+	free(edits);
+}
+
+static void editorJournalApply(struct jrecord *r, int undo)
+{
+	char *s = &J.text[r->off];
+	int op = r->op;
+	if (undo)
+		op ^= 1; // each operation's inverse is its neighbour in journalOp
+
+	switch (op)
+	{
+	case J_INSERT:
+		editorRowInsertString(ptRow(r->row), r->col, s, r->len);
+		break;
+	case J_DELETE:
+		editorRowDelString(ptRow(r->row), r->col, r->len);
+		break;
+	case J_INSROWS:
+		editorInsertRows(r->row, s, r->len);
+		break;
+	case J_DELROWS:
+		editorDelRows(r->row, r->n);
+		break;
+	case J_REPLACE:
+	case J_RESTORE:
+		editorJournalReplay(r, op == J_RESTORE);
+		break;
+	}
+}
+
+void editorUndo()
+{
+	if (J.cur == 0)
+	{
+		editorSetStatusMessage("Nothing to undo");
+		return;
+	}
+
+	int group = J.recs[J.cur - 1].group;
+	J.replaying = 1;
+	while (J.cur > 0 && J.recs[J.cur - 1].group == group)
+		editorJournalApply(&J.recs[--J.cur], 1);
+	J.replaying = 0;
+
+	E.cx = J.recs[J.cur].cx;
+	E.cy = J.recs[J.cur].cy;
+}
+
+void editorRedo()
+{
+	if (J.cur == J.nrecs)
+	{
+		editorSetStatusMessage("Nothing to redo");
+		return;
+	}
+
+	int group = J.recs[J.cur].group;
+	J.replaying = 1;
+	while (J.cur < J.nrecs && J.recs[J.cur].group == group)
+		editorJournalApply(&J.recs[J.cur++], 0);
+	J.replaying = 0;
+
+	E.cx = J.recs[J.cur - 1].acx;
+	E.cy = J.recs[J.cur - 1].acy;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/kwtable.h"
+
+/*
+ * Generates the perfect hash table of keywords for a built-in language.
+ *
+ *   kwgen NAME < lang.syntax > lang.h
+ *
+ * Only the "keywords" and "types" lines of the syntax file are read. The
+ * output defines a struct kwtable called NAME.
+ */
+
+#define KWGEN_MAX_WORDS 4096
+
+static struct kwentry words[KWGEN_MAX_WORDS];
+static int nwords = 0;
+
+static void readWords()
+{
+	char *line = NULL;
+	size_t cap = 0;
+
+	while (getline(&line, &cap, stdin) != -1)
+	{
+		char *key = strtok(line, " \t\r\n");
+		if (key == NULL)
+			continue;
+
+		int type;
+		if (!strcmp(key, "keywords"))
+			type = 1;
+		else if (!strcmp(key, "types"))
+			type = 2;
+		else
+			continue;
+
+		char *w;
+		while ((w = strtok(NULL, " \t\r\n")) != NULL)
+		{
+			if (kwListed(words, nwords, w, strlen(w)))
+				continue;
+			if (nwords == KWGEN_MAX_WORDS)
+			{
+				fprintf(stderr, "kwgen: too many keywords\n");
+				exit(1);
+			}
+			words[nwords].word = strdup(w);
+			words[nwords].len = strlen(w);
+			words[nwords].hl = type;
+			++nwords;
+		}
+	}
+	free(line);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: kwgen NAME < lang.syntax > lang.h\n");
+		return 1;
+	}
+	readWords();
+
+	struct kwtable t;
+	if (kwBuild(&t, words, nwords) == -1)
+	{
+		fprintf(stderr, "kwgen: no collision free table for the keywords\n");
+		return 1;
+	}
+
+	printf("/* Generated by tools/kwgen.c, do not edit. */\n\n");
+	printf("static const struct kwentry %s_slots[%u] =\n{\n", argv[1], t.mask + 1);
+	for (unsigned int i = 0; i <= t.mask; ++i)
+	{
+		const struct kwentry *e = &t.slots[i];
+		if (e->word == NULL)
+			continue;
+		printf("\t[%u] = { \"%s\", %d, %s },\n", i, e->word, e->len,
+			e->hl == 2 ? "HL_KEYWORD2" : "HL_KEYWORD1");
+	}
+	printf("};\n\n");
+	printf("static const struct kwtable %s =\n{\n", argv[1]);
+	printf("\t%s_slots, %u, %uu, %d\n};\n", argv[1], t.mask, t.seed, t.maxlen);
+	return 0;
+}